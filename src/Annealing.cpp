@@ -0,0 +1,275 @@
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <fstream>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <mpi.h>
+#include <omp.h>
+#include "decipher.h"
+#include "Randomize.h"
+#include "ArrayUtilities.h"
+
+
+
+/*
+ * Count the letters of the deciphered text falling in dictionary words, restricted to the positions [lo, hi) of the
+ * ciphered text. A word only counts once a non-alphabetic character terminates it.
+ *
+ * Function Arguments:
+ * code: the ciphered text as symbol indexes, ALPHABET_OUTSIDE for the characters outside the alphabet
+ * decipherkey: maps a ciphered symbol to its deciphered symbol
+ * isletter: whether each deciphered symbol is alphabetic
+ * lo, hi: range of positions to scan; lo must follow a non-alphabetic character (or be 0)
+ * g_dict: the dictionary
+ * return: number of letters covered by dictionary words
+ *
+ * */
+int wordscoreSpan(std::vector<int> &code, KeySymbol *decipherkey, bool *isletter, int lo, int hi, std::map<std::string, int> &g_dict)
+{
+    std::string word="";
+    int score=0;
+
+    for (int i=lo; i<hi; ++i)
+    {
+        if (decipheredLetter(code[i],decipherkey,isletter))
+        {
+            word+=tolower(num2char(decipherkey[code[i]]));
+        }
+        else if (word!="")
+        {
+            if (g_dict.count(word)>0)
+            {
+                score+=word.length();
+            }
+            word="";
+        }
+    }
+    return score;
+}
+
+
+/*
+ * Change in wordscoreSpan over the whole text when ciphered symbols u and v exchange their deciphered symbols.
+ *
+ * Only the words around occurrences of u and v can change. Each occurrence is widened to the nearest positions on
+ * either side whose ciphered symbol is neither u nor v and deciphers to a non-alphabetic character: these positions
+ * are word boundaries under both keys, so the words in between are rescored and nothing else is touched.
+ *
+ * Function Arguments:
+ * code: the ciphered text as symbol indexes, ALPHABET_OUTSIDE for the characters outside the alphabet
+ * occurrences: positions of each ciphered symbol in code, in increasing order
+ * decipherkey: the current decipher key (restored before returning)
+ * isletter: whether each deciphered symbol is alphabetic
+ * u, v: the two ciphered symbols to exchange
+ * g_dict: the dictionary
+ * return: score after the exchange minus score before
+ *
+ * */
+int wordscoreSwapDelta(std::vector<int> &code, std::vector<std::vector<int> > &occurrences, KeySymbol *decipherkey,
+                       bool *isletter, int u, int v, std::map<std::string, int> &g_dict)
+{
+    int n=code.size();
+
+    // Neither symbol deciphers to a letter, so both stay separators and no word can change
+    if ((!isletter[decipherkey[u]])&&(!isletter[decipherkey[v]]))
+    {
+        return 0;
+    }
+
+    // Called at every proposal, so the merged positions live in the scratch arena
+    ArenaScope scratch;
+    size_t npositions=occurrences[u].size()+occurrences[v].size();
+    int *positions=scratch.allocate<int>(npositions);
+    std::merge(occurrences[u].begin(),occurrences[u].end(),occurrences[v].begin(),occurrences[v].end(),positions);
+
+    int delta=0;
+    int covered=-1;
+    for (size_t k=0; k<npositions; ++k)
+    {
+        int p=positions[k];
+        if (p<=covered)
+        {
+            continue;
+        }
+
+        int lo=p-1;
+        while (lo>=0 && (code[lo]==u || code[lo]==v || decipheredLetter(code[lo],decipherkey,isletter)))
+        {
+            --lo;
+        }
+        int hi=p+1;
+        while (hi<n && (code[hi]==u || code[hi]==v || decipheredLetter(code[hi],decipherkey,isletter)))
+        {
+            ++hi;
+        }
+        hi=std::min(hi+1,n);
+
+        delta-=wordscoreSpan(code,decipherkey,isletter,lo+1,hi,g_dict);
+        std::swap(decipherkey[u],decipherkey[v]);
+        delta+=wordscoreSpan(code,decipherkey,isletter,lo+1,hi,g_dict);
+        std::swap(decipherkey[u],decipherkey[v]);
+
+        covered=hi-1;
+    }
+
+    return delta;
+}
+
+
+/*
+ * Simulated annealing on the cipher key with an objective mixing the bigram log-target and the dictionary word-score:
+ *
+ *     f(x) = logtarget(x) + weight * (letters of the deciphered text covered by dictionary words)
+ *
+ * Proposals come from patternProposal: with probability patternprob a ciphered word is reassigned to a dictionary
+ * word of the same letter pattern, otherwise two entries of the key are swapped uniformly. Both terms of f are
+ * updated incrementally per transposition: the bigram term from the rows and columns of the two swapped symbols, the
+ * word-score from the words containing them. The ciphered words matched by the pattern kernel are re-read from the
+ * current key every 1000 proposals, since word boundaries improve as the anneal proceeds. The temperature cools
+ * geometrically from temp0 to temp1 over TT steps. Every MPI process anneals its own chain from x and the best final
+ * key across processes is returned on all of them.
+ *
+ * Function Arguments:
+ * x: the starting cipher key (same convention as logtarget)
+ * Nd: dimension of state space
+ * TT: number of proposals
+ * R: word pair counts from reference text
+ * C: word pair counts from coded text
+ * cipheredstring: the ciphered text
+ * g_dict: the dictionary
+ * weight: weight of the word-score relative to the bigram log-target
+ * temp0: starting annealing temperature
+ * temp1: final annealing temperature
+ * patternprob: probability of a dictionary pattern proposal, 0 for uniform transpositions only
+ * output: the best cipher key found
+ * rank: rank of current MPI process
+ * return: objective value of output
+ *
+ * */
+template<int N, class Count>
+double annealOptimize(KeySymbol *x, int Nd, int TT, Matrix<Count> &R, SparseBigram<Count> &C, std::string cipheredstring, std::map<std::string, int> &g_dict,
+                      double weight, double temp0, double temp1, double patternprob, KeySymbol *output, int rank)
+{
+    Nd=keySize<N>(Nd);
+    alignas(ARRAY_ALIGNMENT) KeySymbol xcur[keyCapacity<N>()];
+    alignas(ARRAY_ALIGNMENT) KeySymbol decipherkey[keyCapacity<N>()];
+    deepcopy1Darray(x,xcur,Nd);
+    cipherkey2decipherkey<N>(xcur,decipherkey,Nd);
+
+    bool isletter[keyCapacity<N>()];
+    for (int i=0; i<Nd; ++i)
+    {
+        isletter[i]=isaphbt(num2char(i));
+    }
+
+    std::vector<int> code;
+    std::vector<std::vector<int> > occurrences(Nd);
+    for (char const &c: cipheredstring)
+    {
+        int s=char2num(c);
+        if (s!=ALPHABET_OUTSIDE)
+        {
+            occurrences[s].push_back(code.size());
+        }
+        code.push_back(s);
+    }
+
+    double bigram=logtarget<N>(xcur,Nd,R,C,1);
+    int words=wordscoreSpan(code,decipherkey,isletter,0,code.size(),g_dict);
+    double objective=bigram+weight*words;
+
+    double bestobjective=objective;
+    alignas(ARRAY_ALIGNMENT) KeySymbol xbest[keyCapacity<N>()];
+    deepcopy1Darray(xcur,xbest,Nd);
+
+    // Index the dictionary by letter pattern and collect the ciphered words to match against it
+    std::map<std::string, std::vector<std::string> > patterns;
+    buildPatternIndex(g_dict,patterns);
+    std::vector<std::vector<int> > cipherwords;
+    std::vector<double> cipherwordsprob;
+    buildCipherWords(code,decipherkey,isletter,patterns,cipherwords,cipherwordsprob);
+
+    double cooling=(TT>1) ? pow(temp1/temp0,1.0/(TT-1)) : 1.0;
+    double temp=temp0;
+    std::vector<std::pair<int, int> > swaps;
+
+    for (int t=0; t<TT; ++t)
+    {
+        // Word boundaries move as separators get fixed, so the ciphered words are refreshed now and then
+        if ((t>0)&&(t%1000==0)&&(patternprob>0))
+        {
+            cipherwords.clear();
+            cipherwordsprob.clear();
+            buildCipherWords(code,decipherkey,isletter,patterns,cipherwords,cipherwordsprob);
+        }
+
+        double logratio=patternProposal(decipherkey,Nd,cipherwords,cipherwordsprob,patterns,patternprob,swaps);
+
+        // Apply the transpositions one by one, accumulating the change of both terms
+        double dbigram=0;
+        int dwords=0;
+        if (logratio>-INFINITY)
+        {
+            for (std::vector<std::pair<int, int> >::size_type k=0; k<swaps.size(); ++k)
+            {
+                int a=swaps[k].first;
+                int b=swaps[k].second;
+                int u=xcur[a];
+                int v=xcur[b];
+                dbigram+=logtargetswapdelta<N>(xcur,decipherkey,Nd,R,C,a,b);
+                dwords+=wordscoreSwapDelta(code,occurrences,decipherkey,isletter,u,v,g_dict);
+                std::swap(xcur[a],xcur[b]);
+                std::swap(decipherkey[u],decipherkey[v]);
+            }
+        }
+
+        double logaccpt=(dbigram+weight*dwords)/temp+logratio;
+
+        if ((logaccpt>=0)||(unifrnd(0,1)<exp(logaccpt)))
+        {
+            bigram+=dbigram;
+            words+=dwords;
+            objective=bigram+weight*words;
+
+            if (objective>bestobjective)
+            {
+                bestobjective=objective;
+                deepcopy1Darray(xcur,xbest,Nd);
+            }
+        } else if (logratio>-INFINITY) {
+            // Undo the transpositions in reverse order
+            for (int k=swaps.size()-1; k>=0; --k)
+            {
+                int a=swaps[k].first;
+                int b=swaps[k].second;
+                std::swap(decipherkey[xcur[a]],decipherkey[xcur[b]]);
+                std::swap(xcur[a],xcur[b]);
+            }
+        }
+
+        temp*=cooling;
+    }
+
+    // Keep the best key over all MPI processes
+    struct {
+        double value;
+        int rank;
+    } local, global;
+    local.value=bestobjective;
+    local.rank=rank;
+    MPI_Allreduce(&local,&global,1,MPI_DOUBLE_INT,MPI_MAXLOC,MPI_COMM_WORLD);
+    MPI_Bcast(xbest,Nd,KEY_MPI_TYPE,global.rank,MPI_COMM_WORLD);
+
+    deepcopy1Darray(xbest,output,Nd);
+    return global.value;
+}
+
+#define INSTANTIATE_ANNEALING(N, Count) \
+    template double annealOptimize<N,Count>(KeySymbol *x, int Nd, int TT, Matrix<Count> &R, SparseBigram<Count> &C, \
+                                            std::string cipheredstring, std::map<std::string, int> &g_dict, \
+                                            double weight, double temp0, double temp1, double patternprob, \
+                                            KeySymbol *output, int rank);
+FOR_EACH_KEY_KERNEL(INSTANTIATE_ANNEALING)
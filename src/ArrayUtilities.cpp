@@ -12,129 +12,27 @@
 #include "ArrayUtilities.h"
 
 
-void conv2Dto1D(int ** input, int *output, int height, int width)
-{
-    for (int i=0; i<height; ++i)
-    {
-        for (int j=0; j<width; ++j)
-        {
-            output[i*height+j]=input[i][j];
-        }
-    }
-}
-
-void conv1Dto2D(int *input, int **output, int height, int width)
-{
-    for (int i=0; i<height; ++i)
-    {
-        for (int j=0; j<width; ++j)
-        {
-            output[i][j]=input[i*height+j];
-        }
-    }
-}
-
-void deepcopy1Darray(int *input, int *output, int Nd)
-{
-    for (int i=0; i<Nd; ++i)
-    {
-        output[i]=input[i];
-    }
-}
-
-void deepcopy2Darray(int **input, int **output, int height, int width)
-{
-    for (int i=0; i<height; ++i)
-    {
-        for (int j=0; j<width; ++j)
-        {
-            output[i][j]=input[i][j];
-        }
-    }
-
-}
-
-
 /*
- * This function fill each entry of A with filler
+ * Block of bytes bytes aligned to ARRAY_ALIGNMENT, to be released with free
  * */
-void init2Darray(int **A, int height, int width, int filler)
-{
-    for (int i=0; i<height; ++i)
-    {
-        for (int j=0; j<width; ++j)
-        {
-            A[i][j]=filler;
-        }
-    }
-}
-
-void print1Darray(int* x, int Nd)
-{
-    for (int i=0; i<Nd; ++i)
-    {
-        std::cout << x[i] << ' ';
-    }
-    std::cout << std::endl;
-}
-
-void create3Dmemory(int ***&ptr, int layers, int height, int width)
+void *alignedAllocate(size_t bytes)
 {
-    ptr=new int **[layers];
-    for(int j = 0; j <layers; ++j)
+    void *block=NULL;
+    if (posix_memalign(&block,ARRAY_ALIGNMENT,std::max(bytes,size_t(1)))!=0)
     {
-        ptr[j] = new int*[height];
-        for(int i = 0; i <height; ++i)
-            ptr[j][i] = new int[width];
+        throw "Could not allocate the array";
     }
-
+    return block;
 }
 
-void free3Dmemory(int ***&ptr, int layers, int height, int width)
-{
-
-    for(int j = 0; j <layers; ++j)
-    {
-        for(int i = 0; i <height; ++i)
-            delete[] ptr[j][i];
-
-        delete[] ptr[j];
-    }
-
-    delete[] ptr;
-
-}
-
-void create2Dmemory(int **&ptr, int height, int width)
-{
-    ptr=new int *[height];
-    for(int i = 0; i <height; ++i)
-        ptr[i] = new int[width];
-}
-
-void free2Dmemory(int **ptr, int height, int width)
-{
-    // Free each subarray
-    for (int i=0; i<height; ++i)
-    {
-        delete[] ptr[i];
-    }
-
-    //Free the array of pointers
-    delete[] ptr;
-}
-
-
-
-
-void print2Darray(int **myArray, int height, int width, std::string filenm)
+void print2Darray(const Matrix<int> &myArray, std::string filenm)
 {
 
     if (filenm=="std")
     {
-        for (int i = 0; i < height; ++i)
+        for (int i = 0; i < myArray.rows; ++i)
         {
-            for (int j = 0; j < width; ++j)
+            for (int j = 0; j < myArray.cols; ++j)
             {
                 std::cout << myArray[i][j] << ' ';
             }
@@ -143,9 +41,9 @@ void print2Darray(int **myArray, int height, int width, std::string filenm)
         }
     } else {
         std::ofstream myfile (filenm);
-        for (int i = 0; i < height; ++i)
+        for (int i = 0; i < myArray.rows; ++i)
         {
-            for (int j = 0; j < width; ++j)
+            for (int j = 0; j < myArray.cols; ++j)
             {
                 myfile << myArray[i][j] << ' ';
             }
@@ -181,16 +79,53 @@ double GetStd(double num[], int n)
 
 
 /*
- * This is function deep copies content of input array a (of length N) to the r-th row of 2D array A.
- *
+ * Allocate bytes bytes from arena a, aligned to ARRAY_ALIGNMENT. When the current block is full the next one is
+ * used, a new block being added, twice as large as the last, only when no block is large enough.
  * */
-
-int assignRow(int **A, int a[], int N, int r)
+void *arenaAllocateBytes(ScratchArena &a, size_t bytes)
 {
-
-    for (int i=0; i<N; i++)
+    bytes=(bytes+ARRAY_ALIGNMENT-1)/ARRAY_ALIGNMENT*ARRAY_ALIGNMENT;
+    while ((a.current>=a.blocks.size())||(a.used+bytes>a.capacity[a.current]))
     {
-        A[r][i]=a[i];
+        if (a.current<a.blocks.size())
+        {
+            a.current+=1;
+            a.used=0;
+        }
+        if (a.current==a.blocks.size())
+        {
+            size_t next=a.capacity.empty() ? size_t(ARENA_BLOCK) : 2*a.capacity.back();
+            a.capacity.push_back(std::max(next,bytes));
+            a.blocks.push_back(static_cast<char*>(alignedAllocate(a.capacity.back())));
+        }
     }
-    return 0;
+    void *buffer=a.blocks[a.current]+a.used;
+    a.used+=bytes;
+    return buffer;
+}
+
+ArenaMark arenaMark(ScratchArena &a)
+{
+    ArenaMark mark;
+    mark.block=a.current;
+    mark.used=a.used;
+    return mark;
+}
+
+/*
+ * Hand back everything allocated from a since mark
+ * */
+void arenaRelease(ScratchArena &a, ArenaMark mark)
+{
+    a.current=mark.block;
+    a.used=mark.used;
+}
+
+/*
+ * Scratch arena of the calling thread, created on first use and freed when the thread ends
+ * */
+ScratchArena &scratchArena()
+{
+    static thread_local ScratchArena arena;
+    return arena;
 }
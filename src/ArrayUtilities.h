@@ -1,15 +1,230 @@
+#ifndef ARRAYUTILITIES_H
+#define ARRAYUTILITIES_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <utility>
+#include <algorithm>
+
+
+// Alignment in bytes of the storage of Matrix and of every scratch buffer
+#define ARRAY_ALIGNMENT 64
+
+// Size in bytes of the first block of a scratch arena; later blocks double in size
+#define ARENA_BLOCK (1<<20)
+
+
 /* ArrayUtilities.cpp */
-int assignRow(int **A, int a[], int N, int r);
-void deepcopy1Darray(int *input, int *output, int Nd);
-void print1Darray(int* x, int Nd);
-void print2Darray(int **myArray, int height, int width, std::string filenm="std");
-void init2Darray(int **A, int height, int width, int filler);
+void *alignedAllocate(size_t bytes);
+
+
+/*
+ * Matrix of rows x cols entries of a trivially copyable type T in one aligned block, row after row with no padding.
+ * m[i] is row i, so m[i][j] reads like the jagged arrays it replaces. The matrix owns its block: it moves but does
+ * not copy, so a swap of two matrices swaps two pointers; copyMatrix copies the entries with one memcpy.
+ * */
+template<class T>
+struct Matrix
+{
+    int rows;
+    int cols;
+    T *data;
+
+    Matrix() : rows(0), cols(0), data(NULL)
+    {
+    }
+
+    Matrix(int height, int width) : rows(height), cols(width),
+                                    data(static_cast<T*>(alignedAllocate(sizeof(T)*size_t(height)*width)))
+    {
+    }
+
+    Matrix(const Matrix &other)=delete;
+    Matrix &operator=(const Matrix &other)=delete;
+
+    Matrix(Matrix &&other) : rows(other.rows), cols(other.cols), data(other.data)
+    {
+        other.rows=0;
+        other.cols=0;
+        other.data=NULL;
+    }
+
+    // The old block of this matrix goes to other, which frees it
+    Matrix &operator=(Matrix &&other)
+    {
+        std::swap(rows,other.rows);
+        std::swap(cols,other.cols);
+        std::swap(data,other.data);
+        return *this;
+    }
+
+    ~Matrix()
+    {
+        free(data);
+    }
+
+    T *operator[](int i)
+    {
+        return data+size_t(i)*cols;
+    }
+
+    const T *operator[](int i) const
+    {
+        return data+size_t(i)*cols;
+    }
+
+    size_t size() const
+    {
+        return size_t(rows)*cols;
+    }
+};
+
+/*
+ * Set every entry of m to filler
+ * */
+template<class T>
+void fillMatrix(Matrix<T> &m, T filler)
+{
+    std::fill(m.data,m.data+m.size(),filler);
+}
+
+/*
+ * Copy the entries of input into output, which has the same shape
+ * */
+template<class T>
+void copyMatrix(const Matrix<T> &input, Matrix<T> &output)
+{
+    std::memcpy(output.data,input.data,sizeof(T)*input.size());
+}
+
+/*
+ * Copy row from of m over row to
+ * */
+template<class T>
+void copyRow(Matrix<T> &m, int from, int to)
+{
+    std::memcpy(m[to],m[from],sizeof(T)*m.cols);
+}
+
+/*
+ * Copy the entries of input into output, which has the same shape, converting them to the entry type of output (a
+ * narrower one when every entry is known to fit)
+ * */
+template<class T, class U>
+void convertMatrix(const Matrix<U> &input, Matrix<T> &output)
+{
+    std::transform(input.data,input.data+input.size(),output.data,[](U v){return T(v);});
+}
+
+/*
+ * Largest entry of m
+ * */
+template<class T>
+T maxEntry(const Matrix<T> &m)
+{
+    return *std::max_element(m.data,m.data+m.size());
+}
+
+template<class T>
+void deepcopy1Darray(const T *input, T *output, int Nd)
+{
+    std::memcpy(output,input,sizeof(T)*Nd);
+}
+
+// Entries are printed as numbers, including the 8-bit ones
+template<class T>
+void print1Darray(const T *x, int Nd)
+{
+    for (int i=0; i<Nd; ++i)
+    {
+        std::cout << +x[i] << ' ';
+    }
+    std::cout << std::endl;
+}
+
+
+/*
+ * Bump allocator for the scratch buffers of the hot loops. Buffers are carved out of a few large aligned blocks, and
+ * arenaRelease hands back everything allocated since a mark at once, so a loop that allocates the same buffers at
+ * every pass reuses the same memory and never calls the allocator once the blocks have grown to its needs. Every
+ * thread has its own arena, see scratchArena; a buffer must not outlive the scope that allocated it (see ArenaScope).
+ * */
+struct ScratchArena
+{
+    std::vector<char*> blocks;
+    std::vector<size_t> capacity;
+    size_t current;
+    size_t used;
+
+    ScratchArena() : current(0), used(0)
+    {
+    }
+
+    ScratchArena(const ScratchArena &other)=delete;
+    ScratchArena &operator=(const ScratchArena &other)=delete;
+
+    ~ScratchArena()
+    {
+        for (size_t k=0; k<blocks.size(); ++k)
+        {
+            free(blocks[k]);
+        }
+    }
+};
+
+// Position of an arena, see arenaMark
+struct ArenaMark
+{
+    size_t block;
+    size_t used;
+};
+
+void *arenaAllocateBytes(ScratchArena &a, size_t bytes);
+ArenaMark arenaMark(ScratchArena &a);
+void arenaRelease(ScratchArena &a, ArenaMark mark);
+ScratchArena &scratchArena();
+
+/*
+ * Uninitialized buffer of n entries of T from arena a
+ * */
+template<class T>
+T *arenaAllocate(ScratchArena &a, size_t n)
+{
+    return static_cast<T*>(arenaAllocateBytes(a,sizeof(T)*n));
+}
+
+/*
+ * The arena of the calling thread, marked on construction and released on destruction: the buffers allocated from
+ * it in between live as long as the scope
+ * */
+struct ArenaScope
+{
+    ScratchArena &arena;
+    ArenaMark mark;
+
+    ArenaScope() : arena(scratchArena()), mark(arenaMark(arena))
+    {
+    }
+
+    ~ArenaScope()
+    {
+        arenaRelease(arena,mark);
+    }
+
+    template<class T>
+    T *allocate(size_t n)
+    {
+        return arenaAllocate<T>(arena,n);
+    }
+};
+
+
+/* ArrayUtilities.cpp */
+void print2Darray(const Matrix<int> &myArray, std::string filenm="std");
 double GetAverage(double num[], int n);
 double GetStd(double num[], int n);
-void free2Dmemory(int **ptr, int height, int width);
-void create2Dmemory(int **&ptr, int height, int width);
-void create3Dmemory(int ***&ptr, int layers, int height, int width);
-void free3Dmemory(int ***&ptr, int layers, int height, int width);
-void deepcopy2Darray(int **input, int **output, int height, int width);
-void conv2Dto1D(int ** input, int *output, int height, int width);
-void conv1Dto2D(int *input, int **output, int height, int width);
+
+#endif
@@ -12,19 +12,54 @@
 #include "ArrayUtilities.h"
 
 
+// Tables of ALPHABET_PRINTABLE, ALPHABET_LETTERS and ALPHABET_BYTES, and the one in use
+static constexpr Alphabet alphabets[3]={buildAlphabet(ALPHABET_PRINTABLE),
+                                        buildAlphabet(ALPHABET_LETTERS),
+                                        buildAlphabet(ALPHABET_BYTES)};
+static int alphabetkind=ALPHABET_PRINTABLE;
 
-void buildDeciphered(std::string inputfile, std::string outputfile, int *decipherkey)
+
+/*
+ * Use the alphabet kind for every translation and pair count from now on. Called once at startup, before any of them.
+ * */
+void selectAlphabet(int kind)
 {
-    std::fstream fin(inputfile, std::fstream::in);
-    std::fstream fout(outputfile, std::fstream::out);
-    char ch;
+    if ((kind<ALPHABET_PRINTABLE)||(kind>ALPHABET_BYTES))
+    {
+        throw "Unknown alphabet";
+    }
+    alphabetkind=kind;
+}
 
-    while (fin >> std::noskipws >> ch) {
-        fout<<decipher(ch, decipherkey);
+const Alphabet &currentAlphabet()
+{
+    return alphabets[alphabetkind];
+}
+
+
+/*
+ * Byte translation table of key: table[b] is the byte written for byte b, b itself if it is outside the alphabet. A
+ * text is then translated one lookup per byte.
+ * */
+void keyTranslation(KeySymbol *key, unsigned char *table)
+{
+    const Alphabet &a=currentAlphabet();
+    for (int b=0; b<256; ++b)
+    {
+        int s=a.symbol[b];
+        table[b]=(s==ALPHABET_OUTSIDE) ? (unsigned char)(b) : a.byte[key[s]];
     }
 }
 
 
+void buildDeciphered(std::string inputfile, std::string outputfile, KeySymbol *decipherkey)
+{
+    std::string text=readcodefile(inputfile);
+    std::fstream fout(outputfile, std::fstream::out);
+    fout<<buildDecipheredstring(text, decipherkey);
+}
+
+
 /*
  * Given file path, read it and return it as a string
  * */
@@ -41,30 +76,48 @@ std::string readcodefile(std::string inputfile)
 }
 
 
+bool isaphbt(char ch)
+{
+    return ((ch>='a' && ch<='z') || (ch>='A' && ch<='Z'));
+}
+
+
 /*
- * Receive an input string and decipher it using decipher key and return deciphered string
+ * Read in the word frequency count text and convert it into a c++ map for fast access
+ *
+ * Function Arguments:
+ * dicttext: the path of the word frequency count text
+ * dict: the dictionary with word as key and frequency as value
  *
  * */
-std::string buildDecipheredstring(std::string inputstring,  int *decipherkey)
+void buildWordsFreqMap(std::string dicttext, std::map<std::string, int> &dict)
 {
-    std::string tempstr="";
+    std::ifstream file(dicttext);
+    std::string s;
+    int ranking=0;
 
-    for (char const &c: inputstring) {
-        tempstr+=decipher(c, decipherkey);
+    while (std::getline(file, s)) {
+        dict[s]=ranking;
+        ranking=ranking+1;
     }
-
-    return tempstr;
 }
 
 
-void cipherkey2decipherkey(int *cipherkey, int *decipherkey, int Nd)
+/*
+ * Receive an input string and decipher it using decipher key and return deciphered string
+ *
+ * */
+std::string buildDecipheredstring(std::string inputstring,  KeySymbol *decipherkey)
 {
-    int container[Nd];
-    for (int i=0; i<Nd; ++i)
-    {
-        container[cipherkey[i]]=i;
+    unsigned char table[256];
+    keyTranslation(decipherkey, table);
+
+    std::string tempstr(inputstring.size(), ' ');
+    for (std::string::size_type i=0; i<inputstring.size(); ++i) {
+        tempstr[i]=char(table[(unsigned char)(inputstring[i])]);
     }
-    deepcopy1Darray(container,decipherkey,Nd);
+
+    return tempstr;
 }
 
 
@@ -73,14 +126,16 @@ void cipherkey2decipherkey(int *cipherkey, int *decipherkey, int Nd)
  *
  *
  * */
-char cipher(char ch, int *cipherkey)
+char cipher(char ch, KeySymbol *cipherkey)
 {
-    return num2char(cipherkey[char2num(ch)]);
+    int s=char2num(ch);
+    return (s==ALPHABET_OUTSIDE) ? ch : num2char(cipherkey[s]);
 }
 
-char decipher(char ch, int *decipherkey)
+char decipher(char ch, KeySymbol *decipherkey)
 {
-    return num2char(decipherkey[char2num(ch)]);
+    int s=char2num(ch);
+    return (s==ALPHABET_OUTSIDE) ? ch : num2char(decipherkey[s]);
 }
 
 
@@ -90,72 +145,94 @@ char decipher(char ch, int *decipherkey)
  * according to the cipher key it receives.
  *
  * */
-void buildCiphered(std::string inputfile, std::string outputfile, int *cipherkey)
+void buildCiphered(std::string inputfile, std::string outputfile, KeySymbol *cipherkey)
 {
-    std::fstream fin(inputfile, std::fstream::in);
+    // Translating by a cipher key is the same operation as translating by a decipher key
+    std::string text=readcodefile(inputfile);
     std::fstream fout(outputfile, std::fstream::out);
-    char ch;
-
-    while (fin >> std::noskipws >> ch) {
-        fout<<cipher(ch, cipherkey);
-    }
-
-
+    fout<<buildDecipheredstring(text, cipherkey);
 }
 
 
 
 /*
- * This function returns the numeric index of the character it receives. The indexing here is based on printable
- * ascii code from 32-126 inclusive--a total of 95 characters.
+ * This function returns the numeric index of the character it receives in the current alphabet, ALPHABET_OUTSIDE for
+ * a character outside it
  * */
 int char2num(char ch)
 {
-    if ((int(ch)>=32) && (int(ch)<=127))
-    {
-        return int(ch-32);
-    }else{
-        return 0;
-    }
+    return currentAlphabet().symbol[(unsigned char)(ch)];
 }
 
 char num2char(int num)
 {
-
-    return char(num+32);
-
+    return char(currentAlphabet().byte[num]);
 }
 
-void buildTransitionMat(int **R, int numchar, std::string file)
+/*
+ * Count the character pairs of the reference texts at sources (files or directories, see countPairs) into R, adding a
+ * pseudo-count of 1 to every pair
+ * */
+void buildTransitionMat(Matrix<uint32_t> &R, int numchar, const std::vector<std::string> &sources)
 {
+    fillMatrix(R, uint32_t(1));
+    countPairs(R, numchar, sources);
+}
 
-    char ch1;
-    char ch2;
 
+
+/*
+ * Count the character pairs of file into the sparse representation C. Unlike buildTransitionMat, only pairs that
+ * occur are stored and no pseudo-count is added. The counts are taken in 32 bits and stored as Count, which must hold
+ * the length of the text (see countsFit).
+ *
+ * Function Arguments:
+ * C: output, the nonzero pair counts by row and by column
+ * numchar: number of characters
+ * file: path of the text to count
+ *
+ * */
+template<class Count>
+void buildSparseTransitionMat(SparseBigram<Count> &C, int numchar, std::string file)
+{
+    Matrix<uint32_t> counts(numchar, numchar);
+    fillMatrix(counts, uint32_t(0));
+    countPairs(counts, numchar, std::vector<std::string>(1, file));
+
+    C.Nd=numchar;
+    C.quantized=false;
+    C.rowptr.assign(1,0);
+    C.col.clear();
+    C.cnt.clear();
     for (int i=0; i<numchar; ++i)
     {
         for (int j=0; j<numchar; ++j)
         {
-            R[i][j]=1;
+            if (counts[i][j]>0)
+            {
+                C.col.push_back(j);
+                C.cnt.push_back(counts[i][j]);
+            }
         }
+        C.rowptr.push_back(C.col.size());
     }
 
-    std::fstream fin(file, std::fstream::in);
-    bool isFirst=1;
-    while (fin >> std::noskipws >> ch2) {
-        if (isFirst) {
-            ch1=ch2;
-            isFirst = 0;
-        } else {
-            R[char2num(ch1)][char2num(ch2)]+=1;
-            ch1=ch2;
+    C.colptr.assign(1,0);
+    C.row.clear();
+    C.colcnt.clear();
+    for (int j=0; j<numchar; ++j)
+    {
+        for (int i=0; i<numchar; ++i)
+        {
+            if (counts[i][j]>0)
+            {
+                C.row.push_back(i);
+                C.colcnt.push_back(counts[i][j]);
+            }
         }
+        C.colptr.push_back(C.row.size());
     }
-
-
 }
 
-
-
-
-
+template void buildSparseTransitionMat<uint16_t>(SparseBigram<uint16_t> &C, int numchar, std::string file);
+template void buildSparseTransitionMat<uint32_t>(SparseBigram<uint32_t> &C, int numchar, std::string file);
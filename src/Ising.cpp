@@ -32,9 +32,19 @@ int main(int argc, char** argv){
     // Each MPI will run S chains
     int S = (argc > 2) ? atoi(argv[2]) : 1;    
 
-    // What decomposition to use: 0-strip, 1-checkerboard
+    // What decomposition to use: 0-strip, 1-checkerboard, 2-multispin checkerboard (64 sites per word),
+    // 3-checkerboard on a lattice distributed over px x py processes, 4-Swendsen-Wang cluster updates,
+    // 5-vectorized checkerboard, 6-temporally blocked checkerboard, 7-checkerboard on batches of 8 chains interleaved
+    // site by site (for many small lattices), 8-checkerboard on a persistent thread team
     int D = (argc > 3) ? atoi(argv[3]) : 1; 
 
+    // Process grid of the distributed decomposition, by default all processes share one lattice
+    int px = (argc > 4) ? atoi(argv[4]) : 0;
+    int py = (argc > 5) ? atoi(argv[5]) : 0;
+
+    // Rows per band of the temporally blocked decomposition; bands of tile rows advance tile/2 half-sweeps at a time
+    int tile = (argc > 6) ? atoi(argv[6]) : 64;
+
     
     // ID of MPI process and number of MPI processes respectively
     int rank, size;
@@ -45,10 +55,35 @@ int main(int argc, char** argv){
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
     // Number of steps each iteration
-    int T=1;
+    int T = (argc > 7) ? atoi(argv[7]) : 1;
+
+    // Whether states exchanged between processes travel one bit per site (1) or as ints (0)
+    int pack = (argc > 8) ? atoi(argv[8]) : 1;
+
+    // Lattice model: 0-2D Ising run by decomposition D, or a heat-bath model on an Nd^dim lattice: 1-3D Ising,
+    // 2-2D 3-state Potts, 3-3D 3-state Potts, 4-2D 4-state Potts, 5-2D Ising
+    int model = (argc > 9) ? atoi(argv[9]) : 0;
+
+    // Whether to pin the OpenMP threads one per CPU (1) or leave them to the operating system (0). The threads are
+    // pinned before any lattice is allocated, so that the rows are placed next to the threads sweeping them.
+    int pin = (argc > 10) ? atoi(argv[10]) : 0;
+    bindThreads(pin);
+
+    // Seed of the starting states and of the generators of the vectorized and batched kernels, to which each process
+    // adds its rank. By default the time, so that runs differ; a fixed seed repeats the sweeps of a run with the same
+    // number of threads.
+    unsigned seed = (argc > 11) ? unsigned(strtoul(argv[11], NULL, 10)) : unsigned(time(0));
 
-    // Pool of chains
+    // Pool of chains, S per process or per group of processes sharing a lattice
     int totalS=size*S;
+    if ((D==3)&&(model==0))
+    {
+        int dims[2]={px,py};
+        MPI_Dims_create((px*py>0) ? px*py : size,2,dims);
+        px=dims[0];
+        py=dims[1];
+        totalS=(size/(px*py))*S;
+    }
 
     // Total number of iterations
     int iterNum=100;
@@ -65,7 +100,15 @@ int main(int argc, char** argv){
     {
         temps[i]=hightemp-increment*i;
     }
-    temperedChainsIsing(iterNum, totalS, Nd, T, temps,  rank, size,D);
+    if (model!=0)
+    {
+        temperedChainsLattice(model, iterNum, totalS, Nd, T, temps, rank, size);
+    } else if (D==3)
+    {
+        temperedChainsIsingDistributed(iterNum, totalS, Nd, T, temps, rank, size, px, py, pack);
+    } else {
+        temperedChainsIsing(iterNum, totalS, Nd, T, temps,  rank, size,D,tile,pack,seed);
+    }
 
     MPI_Barrier(MPI_COMM_WORLD);
     MPI_Finalize();
@@ -1,6 +1,579 @@
+#ifndef ISING_H
+#define ISING_H
 
-void oneChainIsing(int **x, int T, int Nd, double temp);
-double logtargetIsing(int **x, int Nd,double temp);
-double t(int **x, int Nd);
-void temperedChainsIsing(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size, int kernel);
-void oneChainIsingChess(int **x, int T, int Nd, double temp);
\ No newline at end of file
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <mpi.h>
+
+// Ints before the first site of a row of a SplitLattice, its left ghost being the last of them: one alignment block
+#define SPLIT_PAD 16
+
+/*
+ * Multispin coded lattice: one bit per site. The two checkerboard colours are stored apart; row i of colour c holds
+ * the sites (i,j) with (i+j)%2==c, site j being bit j/2, in words 64-bit words. The vertical neighbours of a site are
+ * then the same bit of the neighbouring rows of the other colour, and the horizontal ones the same bit and the bit
+ * next to it in the same row of the other colour.
+ * */
+struct MultispinLattice
+{
+    int Nd;
+    int half;
+    int words;
+    std::vector<uint64_t> bits;
+};
+
+/*
+ * Lattice of side Nd (even) stored colour by colour for the vectorized kernel: row i of colour c holds the sites (i,j)
+ * with (i+j)%2==c, site j at k=j/2, as in MultispinLattice but one int per site, so every lane of a vector holds a site
+ * of the colour being updated. The vertical neighbours of site k are site k of the neighbouring rows of the other
+ * colour, and the horizontal ones sites k and k+1 (i+c odd) or k-1 (i+c even) of the same row of the other colour.
+ * Each colour is a plane of Nd+2 rows of stride ints with ghost rows and ghost sites -1 and half on either side of
+ * each row; rows start on an alignment boundary, so the neighbour sums take aligned loads but for the shifted one.
+ * See splitRow.
+ * */
+struct SplitLattice
+{
+    int Nd;
+    int half;
+    int stride;
+    int *sites;
+};
+
+/*
+ * Pointer to site k=0 of row i (-1..Nd) of colour c of the split lattice
+ * */
+inline int *splitRow(SplitLattice &p, int c, int i)
+{
+    return p.sites+(size_t(c)*(p.Nd+2)+i+1)*p.stride+SPLIT_PAD;
+}
+
+/*
+ * Lattice of rows x cols sites stored in one aligned block with ghost rows and columns. Row i (-1..rows) starts stride
+ * ints after row i-1; the ghosts at row -1 and rows and column -1 and cols hold the sites across the edge (the
+ * opposite edge for a whole periodic lattice, see refreshHalo, or the neighbouring tile for a distributed one), so
+ * the neighbours of a site are always at offsets -1, +1, -stride and +stride.
+ * */
+struct PaddedLattice
+{
+    int rows;
+    int cols;
+    int stride;
+    int size;
+    int *sites;
+};
+
+/*
+ * Pointer to site (i,0) of the padded lattice, i from -1 to rows
+ * */
+inline int *latticeRow(PaddedLattice &p, int i)
+{
+    return p.sites+(i+1)*p.stride+1;
+}
+
+/*
+ * Acceptance probabilities of the Ising kernels at one temperature, indexed by the neighbour sum s=0..4: gibbs[s] is
+ * the probability that a Gibbs update sets the site to 1 and metropolis[v][s] the probability that a Metropolis update
+ * flips a site currently at spin v. bond and clusterfield drive the cluster kernel. See buildIsingLUT.
+ * */
+struct IsingLUT
+{
+    double temp;
+    double field;
+    double gibbs[5];
+    double metropolis[2][5];
+    double bond;
+    double clusterfield;
+};
+
+/*
+ * Gibbs update of one site of a padded lattice given a uniform number u: the neighbours are read at fixed offsets, the
+ * ghosts standing in for the sites across the edge. Returns the change of t().
+ * */
+inline int gibbsSite(int *site, int stride, const IsingLUT &lut, double u)
+{
+    int s=site[-stride]+site[stride]+site[-1]+site[1];
+    int old=*site;
+    *site=(u<lut.gibbs[s]);
+    return (*site-old)*s;
+}
+
+// Number of lattices updated together by the batched kernel, one per 32-bit lane of a 256-bit vector
+#define BATCH_WIDTH 8
+
+/*
+ * BATCH_WIDTH lattices of side Nd interleaved site by site, with ghost rows and columns: the copies of site (i,j),
+ * i and j from -1 to Nd, are consecutive, and rows are stride ints apart. See batchSite.
+ * */
+struct BatchedLattice
+{
+    int Nd;
+    int stride;
+    std::vector<int32_t> sites;
+};
+
+/*
+ * Pointer to the BATCH_WIDTH copies of site (i,j) of the batch
+ * */
+inline int32_t *batchSite(BatchedLattice &b, int i, int j)
+{
+    return b.sites.data()+size_t(i+1)*b.stride+size_t(j+1)*BATCH_WIDTH;
+}
+
+/*
+ * One chain of the batched kernel: lane lane of batch batch of the BatchedIsingModel holding it
+ * */
+struct BatchedChain
+{
+    int batch;
+    int lane;
+};
+
+/*
+ * Per-thread state of the vectorized generator: 4 xorshift128+ lanes, one 64-bit output per lane per step
+ * */
+struct SimdRng
+{
+    uint64_t s0[4];
+    uint64_t s1[4];
+};
+
+/*
+ * Place of one rank's tile in a lattice block-decomposed over a periodic 2D Cartesian communicator: the size of the
+ * tile, the global position of its site (0,0), the ranks holding the neighbouring tiles and the MPI datatype of one
+ * column of a padded tile.
+ * */
+struct LatticeTiling
+{
+    MPI_Comm cart;
+    int rows;
+    int cols;
+    int rowoffset;
+    int coloffset;
+    int up;
+    int down;
+    int left;
+    int right;
+    MPI_Datatype column;
+};
+
+/*
+ * How the interior of padded lattices of one shape travels between ranks: either in place through the derived
+ * datatype sites, which skips the ghosts and the row padding, or packed one bit per site in the preallocated buffers
+ * sendbits and recvbits. See createTransfer and swapLattice.
+ * */
+struct LatticeTransfer
+{
+    int packed;
+    MPI_Datatype sites;
+    std::vector<uint64_t> sendbits;
+    std::vector<uint64_t> recvbits;
+};
+
+/*
+ * One record of the observables stream: the state at temperature slot temp after iteration iter, the replica it
+ * started as, and whether an exchange of this slot was proposed (1) or accepted (2) in the iteration (0 otherwise).
+ * Replicas move between slots with the accepted exchanges, so the stream can be read per replica or per temperature.
+ * */
+struct ObservableRecord
+{
+    int32_t iter;
+    int32_t temp;
+    int32_t replica;
+    int32_t exchanged;
+    double energy;
+    double magnetization;
+};
+
+/*
+ * Online statistics of one observable in constant memory: Welford mean and sum of squared deviations, and the lagged
+ * products of the samples (shifted by the first one) up to a maximum lag, from which the autocorrelations are formed.
+ * head keeps the first samples and tail the latest ones, as a ring. See addSample and autocorrelationTime.
+ * */
+struct OnlineStats
+{
+    long n;
+    double mean;
+    double m2;
+    double shift;
+    double sum;
+    std::vector<double> head;
+    std::vector<double> tail;
+    std::vector<double> lagsum;
+};
+
+/*
+ * Statistics of one temperature slot: energy t(), magnetization and exchanges proposed and accepted
+ * */
+struct SlotObservables
+{
+    OnlineStats energy;
+    OnlineStats magnetization;
+    int proposed;
+    int accepted;
+};
+
+/*
+ * Binary stream of observable records. Records are appended to filling; a full buffer is handed to a background
+ * thread through writing, so the chains only wait for the disk when it falls a whole buffer behind.
+ * */
+struct ObservableWriter
+{
+    std::ofstream file;
+    std::vector<ObservableRecord> filling;
+    std::vector<ObservableRecord> writing;
+    bool pending;
+    bool done;
+    std::mutex lock;
+    std::condition_variable ready;
+    std::thread thread;
+};
+
+/*
+ * Observables of the slots of one group of processes, as recorded by the Ising models of temperedChains: the records
+ * go to observables<id>.bin and the statistics to summary<id>.txt. Only the root of the group records (active).
+ * */
+struct SlotRecorder
+{
+    bool active;
+    int id;
+    int first;
+    const double *temps;
+    ObservableWriter writer;
+    std::vector<SlotObservables> obs;
+};
+
+/*
+ * Per-thread state of a SpinTeam member, one cache line apart from the next member's so that the spinning and the
+ * partial sums of one thread do not invalidate the line of another
+ * */
+struct alignas(64) TeamMember
+{
+    int sense;
+    double result;
+};
+
+// Jobs of a SpinTeam
+#define TEAM_STOP 0
+#define TEAM_SWEEP 1
+#define TEAM_MAGNETIZATION 2
+#define TEAM_ENERGY 3
+
+/*
+ * Persistent team of threads for the checkerboard kernel on one process. The calling thread is member 0 and
+ * size-1 workers wait between jobs; member k always owns the same rows, rows*k/size to rows*(k+1)/size-1, of every
+ * lattice. A job (a sweep, or a sum over the lattice) is posted in the job fields and started and finished with the
+ * sense-reversing spin barrier made of arrived and sense, which also separates the half-sweeps.
+ * */
+struct SpinTeam
+{
+    int size;
+    std::vector<std::thread> workers;
+    std::vector<TeamMember> members;
+    std::vector<std::mt19937> gens;
+    std::atomic<int> arrived;
+    std::atomic<int> sense;
+
+    int job;
+    PaddedLattice *x;
+    const IsingLUT *lut;
+    int T;
+};
+
+/*
+ * The 2D Ising model on padded lattices of side Nd, run by kernel Kernel of temperedChainsIsing, as a model of
+ * temperedChains (see TemperedChains.h). The kernel is fixed at compile time, so each kernel gets its own copy of the
+ * replica exchange with no branch on it. The model keeps the generator of the starting states, the team of the team
+ * kernel and the transfer of states to other processes. The multispin, vectorized and batched kernels have models of
+ * their own.
+ * */
+template<int Kernel>
+struct SquareIsingModel
+{
+    typedef PaddedLattice State;
+    typedef IsingLUT Table;
+
+    MPI_Comm group;
+    int schedule;
+    int Nd;
+    int tile;
+    std::mt19937 initgen;
+    LatticeTransfer transfer;
+    SpinTeam team;
+    SlotRecorder recorder;
+
+    void create(PaddedLattice &x, double temp);
+    void release(PaddedLattice &x);
+    void buildTable(IsingLUT &lut, double temp);
+    double sweep(PaddedLattice &x, int T, const IsingLUT &lut);
+    void sweepChains(std::vector<PaddedLattice> &xs, std::vector<IsingLUT> &luts, int T, std::vector<double> &energies);
+    double energy(PaddedLattice &x);
+    double magnetization(PaddedLattice &x);
+    double logTarget(double energy, double temp);
+    void trade(PaddedLattice &x, int other, MPI_Comm comm);
+    void begin(int id, int first, int S, const double *temps);
+    void observe(int iter, int slot, int replica, int exchanged, double energy, PaddedLattice &x);
+    void end(double seconds);
+};
+
+/*
+ * The 2D Ising model with every lattice split over a group of px*py processes, as a model of temperedChains. Each
+ * process holds its tile of every chain of the group; energies and magnetizations are summed over the group.
+ * */
+struct DistributedIsingModel
+{
+    typedef PaddedLattice State;
+    typedef IsingLUT Table;
+
+    MPI_Comm group;
+    int schedule;
+    LatticeTiling tl;
+    LatticeTransfer transfer;
+    std::vector<std::mt19937> gens;
+    SlotRecorder recorder;
+
+    void create(PaddedLattice &x, double temp);
+    void release(PaddedLattice &x);
+    void buildTable(IsingLUT &lut, double temp);
+    void sweepChains(std::vector<PaddedLattice> &xs, std::vector<IsingLUT> &luts, int T, std::vector<double> &energies);
+    double energy(PaddedLattice &x);
+    double logTarget(double energy, double temp);
+    void trade(PaddedLattice &x, int other, MPI_Comm comm);
+    void begin(int id, int first, int S, const double *temps);
+    void observe(int iter, int slot, int replica, int exchanged, double energy, PaddedLattice &x);
+    void end(double seconds);
+};
+
+/*
+ * The 2D Ising model run by the batched kernel, as a model of temperedChains. The chains live in the lanes of batches
+ * of BATCH_WIDTH lattices from the first iteration to the last: a state is a lane, an exchange within the process
+ * swaps lanes between slots, and a lane is only copied out, to scratch, when it is traded with another process. The
+ * magnetizations of all lanes are summed once per sweep, in mags; lanelut and laneslot map the lanes to the tables
+ * and slots of the chains they hold.
+ * */
+struct BatchedIsingModel
+{
+    typedef BatchedChain State;
+    typedef IsingLUT Table;
+
+    MPI_Comm group;
+    int schedule;
+    int Nd;
+    int chains;
+    std::vector<BatchedLattice> batches;
+    std::vector<double> mags;
+    std::vector<const IsingLUT*> lanelut;
+    std::vector<int> laneslot;
+    std::mt19937 initgen;
+    std::vector<SimdRng> simdrngs;
+    PaddedLattice scratch;
+    LatticeTransfer transfer;
+    SlotRecorder recorder;
+
+    void create(BatchedChain &x, double temp);
+    void release(BatchedChain &x);
+    void buildTable(IsingLUT &lut, double temp);
+    void sweepChains(std::vector<BatchedChain> &xs, std::vector<IsingLUT> &luts, int T, std::vector<double> &energies);
+    double energy(BatchedChain &x);
+    double logTarget(double energy, double temp);
+    void trade(BatchedChain &x, int other, MPI_Comm comm);
+    void begin(int id, int first, int S, const double *temps);
+    void observe(int iter, int slot, int replica, int exchanged, double energy, BatchedChain &x);
+    void end(double seconds);
+};
+
+/*
+ * The 2D Ising model run by the multispin kernel, as a model of temperedChains. The packed lattice is the state of the
+ * chain, so no sweep packs or unpacks a lattice, and states are traded with other processes as the packed words.
+ * */
+struct MultispinIsingModel
+{
+    typedef MultispinLattice State;
+    typedef IsingLUT Table;
+
+    MPI_Comm group;
+    int schedule;
+    int Nd;
+    SlotRecorder recorder;
+
+    void create(MultispinLattice &x, double temp);
+    void release(MultispinLattice &x);
+    void buildTable(IsingLUT &lut, double temp);
+    void sweepChains(std::vector<MultispinLattice> &xs, std::vector<IsingLUT> &luts, int T,
+                     std::vector<double> &energies);
+    double energy(MultispinLattice &x);
+    double logTarget(double energy, double temp);
+    void trade(MultispinLattice &x, int other, MPI_Comm comm);
+    void begin(int id, int first, int S, const double *temps);
+    void observe(int iter, int slot, int replica, int exchanged, double energy, MultispinLattice &x);
+    void end(double seconds);
+};
+
+/*
+ * The 2D Ising model run by the vectorized kernel, as a model of temperedChains. The split lattice the kernel sweeps is
+ * the state of the chain, and states are traded with other processes as the two planes, ghosts included.
+ * */
+struct SimdIsingModel
+{
+    typedef SplitLattice State;
+    typedef IsingLUT Table;
+
+    MPI_Comm group;
+    int schedule;
+    int Nd;
+    std::mt19937 initgen;
+    std::vector<SimdRng> simdrngs;
+    SlotRecorder recorder;
+
+    void create(SplitLattice &x, double temp);
+    void release(SplitLattice &x);
+    void buildTable(IsingLUT &lut, double temp);
+    void sweepChains(std::vector<SplitLattice> &xs, std::vector<IsingLUT> &luts, int T, std::vector<double> &energies);
+    double energy(SplitLattice &x);
+    double logTarget(double energy, double temp);
+    void trade(SplitLattice &x, int other, MPI_Comm comm);
+    void begin(int id, int first, int S, const double *temps);
+    void observe(int iter, int slot, int replica, int exchanged, double energy, SplitLattice &x);
+    void end(double seconds);
+};
+
+void buildIsingLUT(IsingLUT &lut, double temp, double field=0);
+int gibbsRow(PaddedLattice &x, int i, const IsingLUT &lut, std::mt19937 &gen);
+double oneChainIsing(PaddedLattice &x, int T, const IsingLUT &lut);
+double logtargetIsing(double energy, double temp);
+double t(PaddedLattice &x);
+double magnetization(PaddedLattice &x);
+void temperedChainsIsing(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size, int kernel, int tile, int pack,
+                         unsigned seed);
+double oneChainIsingChess(PaddedLattice &x, int T, const IsingLUT &lut);
+template<int Kernel>
+void createSquareIsing(SquareIsingModel<Kernel> &m, int Nd, int tile, int pack, int rank, unsigned seed);
+template<int Kernel>
+void freeSquareIsing(SquareIsingModel<Kernel> &m);
+template<int Kernel>
+void temperedChainsSquare(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size, int tile, int pack,
+                          unsigned seed);
+
+/* IsingLattice.cpp */
+void createLattice(PaddedLattice &p, int rows, int cols);
+void firstTouchLattice(PaddedLattice &p, int slack);
+void freeLattice(PaddedLattice &p);
+void bindThreads(int pin);
+void pinThread(int k);
+void refreshHalo(PaddedLattice &p);
+void refreshGhostRows(PaddedLattice &p);
+int latticeStride(int cols);
+void createTransfer(LatticeTransfer &tr, PaddedLattice &p, int packed);
+void freeTransfer(LatticeTransfer &tr);
+void packSpins(PaddedLattice &p, uint64_t *bits);
+void unpackSpins(const uint64_t *bits, PaddedLattice &p);
+void swapLattice(PaddedLattice &p, LatticeTransfer &tr, int other, MPI_Comm comm);
+
+/* IsingDistributed.cpp */
+void createTiling(LatticeTiling &tl, MPI_Comm group, int Nd, int px, int py);
+void freeTiling(LatticeTiling &tl);
+void startHaloExchange(PaddedLattice &x, LatticeTiling &tl, MPI_Request *requests);
+void exchangeHalo(PaddedLattice &x, LatticeTiling &tl);
+int gibbsTileRange(PaddedLattice &x, LatticeTiling &tl, int i, int jlo, int jhi, int c, const IsingLUT &lut, std::mt19937 &gen);
+double sweepTile(PaddedLattice &x, LatticeTiling &tl, int T, const IsingLUT &lut, std::vector<std::mt19937> &gens);
+double tTile(PaddedLattice &x, LatticeTiling &tl);
+void createDistributedIsing(DistributedIsingModel &m, int Nd, int px, int py, int pack, int rank);
+void freeDistributedIsing(DistributedIsingModel &m);
+void temperedChainsIsingDistributed(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size, int px, int py, int pack);
+
+/* IsingMultispin.cpp */
+void createMultispin(MultispinLattice &p, int Nd);
+uint64_t *multispinRow(MultispinLattice &p, int c, int i);
+void shiftprev(const uint64_t *in, uint64_t *out, int H, int W);
+void shiftnext(const uint64_t *in, uint64_t *out, int H, int W);
+void multispinNeighbours(MultispinLattice &p, int c, int i, uint64_t *shifted, uint64_t *s0, uint64_t *s1, uint64_t *s2);
+double sweepMultispin(MultispinLattice &p, int T, const IsingLUT &lut);
+double tMultispin(MultispinLattice &p);
+double magnetizationMultispin(MultispinLattice &p);
+void createMultispinIsing(MultispinIsingModel &m, int Nd);
+void temperedChainsIsingMultispin(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size);
+
+/* IsingCluster.cpp */
+int clusterFind(int *parent, int k);
+void clusterUnion(int *parent, int a, int b);
+double oneChainIsingCluster(PaddedLattice &x, int T, const IsingLUT &lut);
+
+/* IsingSimd.cpp */
+uint64_t splitmix64(uint64_t &state);
+void seedSimdRng(std::vector<SimdRng> &rngs, int count, uint64_t seed);
+void simdRandom(SimdRng &rng, uint32_t *out);
+void createSplit(SplitLattice &p, int Nd);
+void freeSplit(SplitLattice &p);
+void refreshSplitColumns(SplitLattice &p, int c, int i);
+void refreshSplitRows(SplitLattice &p, int c);
+void refreshSplit(SplitLattice &p);
+int simdRow(int *row, const int *up, const int *down, const int *other, int shift, int half, const int32_t *threshold,
+            SimdRng &rng);
+double oneChainIsingSimd(SplitLattice &x, int T, const IsingLUT &lut, std::vector<SimdRng> &rngs);
+double tSplit(SplitLattice &p);
+double magnetizationSplit(SplitLattice &p);
+void createSimdIsing(SimdIsingModel &m, int Nd, int rank, unsigned seed);
+void temperedChainsIsingSimd(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size, unsigned seed);
+
+/* IsingTemporal.cpp */
+int temporalRow(PaddedLattice &x, int i, int c, const IsingLUT &lut, std::mt19937 &gen);
+int temporalTrapezoid(PaddedLattice &x, int lo, int hi, int dlo, int dhi, int H, int c0, const IsingLUT &lut, std::mt19937 &gen);
+double oneChainIsingTemporal(PaddedLattice &x, int T, const IsingLUT &lut, int tile);
+
+/* IsingObservables.cpp */
+void createStats(OnlineStats &s);
+void addSample(OnlineStats &s, double x);
+double statsVariance(const OnlineStats &s);
+double autocovariance(const OnlineStats &s, int k);
+double autocorrelationTime(const OnlineStats &s);
+double effectiveSamples(const OnlineStats &s);
+void createSlotObservables(std::vector<SlotObservables> &obs, int slots);
+void openObservables(ObservableWriter &w, std::string filenm, const double *temps, int slots, int first);
+void observableWriterLoop(ObservableWriter *w);
+void flushObservables(ObservableWriter &w);
+void closeObservables(ObservableWriter &w);
+void recordObservables(ObservableWriter &w, SlotObservables &obs, int iter, int slot, int replica, int exchanged,
+                       double energy, double mag);
+void printObservableSummary(std::vector<SlotObservables> &obs, const double *temps, int first, double seconds,
+                            std::string filenm);
+void openRecorder(SlotRecorder &rec, bool active, int id, int first, int S, const double *temps);
+void recordSlot(SlotRecorder &rec, int iter, int slot, int replica, int exchanged, double energy, double mag);
+void closeRecorder(SlotRecorder &rec, double seconds);
+
+/* IsingModels.cpp */
+void temperedChainsLattice(int model, int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size);
+
+/* IsingBatched.cpp */
+void createBatch(BatchedLattice &b, int Nd);
+void packLane(PaddedLattice &x, BatchedLattice &b, int w);
+void unpackLane(BatchedLattice &b, int w, PaddedLattice &x);
+void refreshBatchColumns(BatchedLattice &b, int i);
+void refreshBatchRows(BatchedLattice &b);
+void refreshBatch(BatchedLattice &b);
+void batchEnergies(BatchedLattice &b, double *energies);
+void batchMagnetizations(BatchedLattice &b, double *mags);
+void batchedRow(BatchedLattice &b, int i, int c, const int32_t *threshold, SimdRng &rng, int *delta);
+void oneChainsIsingBatched(BatchedLattice &b, const IsingLUT **luts, int T, std::vector<SimdRng> &rngs,
+                           double *deltas);
+void createBatchedIsing(BatchedIsingModel &m, int Nd, int totalS, int pack, int rank, unsigned seed);
+void freeBatchedIsing(BatchedIsingModel &m);
+void temperedChainsIsingBatched(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size, int pack,
+                                unsigned seed);
+
+/* IsingTeam.cpp */
+void createTeam(SpinTeam &team, int size, unsigned seed);
+void freeTeam(SpinTeam &team);
+void teamBarrier(SpinTeam &team, int k);
+void teamWorker(SpinTeam *team, int k);
+void teamJob(SpinTeam &team, int k);
+double runTeamJob(SpinTeam &team, int job, PaddedLattice &x, const IsingLUT *lut, int T);
+int teamRow(PaddedLattice &x, int i, int c, const IsingLUT &lut, std::mt19937 &gen);
+double oneChainIsingTeam(SpinTeam &team, PaddedLattice &x, int T, const IsingLUT &lut);
+
+#endif
@@ -0,0 +1,457 @@
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <mpi.h>
+#include <omp.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "Ising.h"
+#include "TemperedChains.h"
+
+
+/*
+ * Allocate a batch of BATCH_WIDTH lattices of side Nd, interleaved site by site: the BATCH_WIDTH copies of site (i,j)
+ * are consecutive, at batchSite(b,i,j). One ghost row and column surround the lattice on each side.
+ * */
+void createBatch(BatchedLattice &b, int Nd)
+{
+    b.Nd=Nd;
+    b.stride=(Nd+2)*BATCH_WIDTH;
+    b.sites.assign(size_t(Nd+2)*b.stride,0);
+}
+
+
+/*
+ * Copy lattice x into lane w of b and refresh the ghosts of the batch
+ * */
+void packLane(PaddedLattice &x, BatchedLattice &b, int w)
+{
+    int Nd=b.Nd;
+    for (int i=0; i<Nd; ++i)
+    {
+        const int *row=latticeRow(x,i);
+        int32_t *site=batchSite(b,i,0)+w;
+        for (int j=0; j<Nd; ++j)
+        {
+            site[j*BATCH_WIDTH]=row[j];
+        }
+    }
+    refreshBatch(b);
+}
+
+void unpackLane(BatchedLattice &b, int w, PaddedLattice &x)
+{
+    int Nd=b.Nd;
+    for (int i=0; i<Nd; ++i)
+    {
+        int *row=latticeRow(x,i);
+        const int32_t *site=batchSite(b,i,0)+w;
+        for (int j=0; j<Nd; ++j)
+        {
+            row[j]=site[j*BATCH_WIDTH];
+        }
+    }
+    refreshHalo(x);
+}
+
+/*
+ * Copy the first and last sites of row i of every lane into the ghost columns of the row
+ * */
+void refreshBatchColumns(BatchedLattice &b, int i)
+{
+    std::copy(batchSite(b,i,b.Nd-1),batchSite(b,i,b.Nd),batchSite(b,i,-1));
+    std::copy(batchSite(b,i,0),batchSite(b,i,1),batchSite(b,i,b.Nd));
+}
+
+void refreshBatchRows(BatchedLattice &b)
+{
+    int Nd=b.Nd;
+    std::copy(batchSite(b,Nd-1,-1),batchSite(b,Nd-1,-1)+b.stride,batchSite(b,-1,-1));
+    std::copy(batchSite(b,0,-1),batchSite(b,0,-1)+b.stride,batchSite(b,Nd,-1));
+}
+
+void refreshBatch(BatchedLattice &b)
+{
+    for (int i=0; i<b.Nd; ++i)
+    {
+        refreshBatchColumns(b,i);
+    }
+    refreshBatchRows(b);
+}
+
+
+/*
+ * t() of every lane of the batch, in one pass over the sites that sums the BATCH_WIDTH lanes side by side
+ * */
+void batchEnergies(BatchedLattice &b, double *energies)
+{
+    int Nd=b.Nd;
+    int stride=b.stride;
+    std::fill(energies,energies+BATCH_WIDTH,0.0);
+
+#pragma omp parallel
+    {
+        int pairs[BATCH_WIDTH]={0};
+
+#pragma omp for schedule(static)
+        for (int i=0; i<Nd; ++i)
+        {
+            const int32_t *site=batchSite(b,i,0);
+            for (int j=0; j<Nd; ++j)
+            {
+                for (int w=0; w<BATCH_WIDTH; ++w)
+                {
+                    pairs[w]+=site[w]*(site[w+BATCH_WIDTH]+site[w+stride]);
+                }
+                site+=BATCH_WIDTH;
+            }
+        }
+
+#pragma omp critical
+        for (int w=0; w<BATCH_WIDTH; ++w)
+        {
+            energies[w]+=pairs[w];
+        }
+    }
+}
+
+/*
+ * Magnetization of every lane of the batch, the sum of its spins read as -1 and +1
+ * */
+void batchMagnetizations(BatchedLattice &b, double *mags)
+{
+    int Nd=b.Nd;
+    for (int w=0; w<BATCH_WIDTH; ++w)
+    {
+        mags[w]=-double(Nd)*Nd;
+    }
+
+#pragma omp parallel
+    {
+        int up[BATCH_WIDTH]={0};
+
+#pragma omp for schedule(static)
+        for (int i=0; i<Nd; ++i)
+        {
+            const int32_t *site=batchSite(b,i,0);
+            for (int j=0; j<Nd; ++j)
+            {
+                for (int w=0; w<BATCH_WIDTH; ++w)
+                {
+                    up[w]+=site[w];
+                }
+                site+=BATCH_WIDTH;
+            }
+        }
+
+#pragma omp critical
+        for (int w=0; w<BATCH_WIDTH; ++w)
+        {
+            mags[w]+=2*up[w];
+        }
+    }
+}
+
+
+/*
+ * Gibbs update of the sites of colour c in row i of every lane of the batch. Each step loads the neighbour sums of
+ * one site in the 8 lanes, looks the thresholds of the 8 lanes up with a gather (each lane has its own temperature),
+ * and draws the 8 uniform numbers from one step of the 4-lane generator. Without AVX2 the same numbers are compared
+ * in scalar code, so both builds give the same chains.
+ *
+ * Function Argument:
+ * b: the batch
+ * i: the row
+ * c: colour (parity of i+j) of the sites to update
+ * threshold: entry s*BATCH_WIDTH+w is 2^31 times the probability that lane w sets a site of neighbour sum s to 1
+ * rng: generator of the current thread
+ * delta: the change of t() of every lane is added to delta[w]
+ *
+ * */
+void batchedRow(BatchedLattice &b, int i, int c, const int32_t *threshold, SimdRng &rng, int *delta)
+{
+    int Nd=b.Nd;
+    int stride=b.stride;
+#ifdef __AVX2__
+    __m256i s0=_mm256_loadu_si256((const __m256i*)rng.s0);
+    __m256i s1=_mm256_loadu_si256((const __m256i*)rng.s1);
+    __m256i lane=_mm256_setr_epi32(0,1,2,3,4,5,6,7);
+    __m256i one=_mm256_set1_epi32(1);
+    __m256i change=_mm256_setzero_si256();
+
+    for (int j=(i+c)%2; j<Nd; j+=2)
+    {
+        // xorshift128+ on 4 lanes, 8 numbers of 31 bits
+        __m256i x=s0;
+        __m256i y=s1;
+        s0=y;
+        x=_mm256_xor_si256(x,_mm256_slli_epi64(x,23));
+        s1=_mm256_xor_si256(_mm256_xor_si256(x,y),_mm256_xor_si256(_mm256_srli_epi64(x,17),_mm256_srli_epi64(y,26)));
+        __m256i u=_mm256_srli_epi32(_mm256_add_epi64(s1,y),1);
+
+        int32_t *site=batchSite(b,i,j);
+        __m256i sum=_mm256_add_epi32(_mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(site-stride)),
+                                                      _mm256_loadu_si256((const __m256i*)(site+stride))),
+                                     _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(site-BATCH_WIDTH)),
+                                                      _mm256_loadu_si256((const __m256i*)(site+BATCH_WIDTH))));
+        __m256i p=_mm256_i32gather_epi32((const int*)threshold,_mm256_add_epi32(_mm256_slli_epi32(sum,3),lane),4);
+        __m256i newsites=_mm256_and_si256(_mm256_cmpgt_epi32(p,u),one);
+        __m256i old=_mm256_loadu_si256((const __m256i*)site);
+        change=_mm256_add_epi32(change,_mm256_mullo_epi32(_mm256_sub_epi32(newsites,old),sum));
+        _mm256_storeu_si256((__m256i*)site,newsites);
+    }
+
+    _mm256_storeu_si256((__m256i*)rng.s0,s0);
+    _mm256_storeu_si256((__m256i*)rng.s1,s1);
+
+    int lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes,change);
+    for (int w=0; w<BATCH_WIDTH; ++w)
+    {
+        delta[w]+=lanes[w];
+    }
+#else
+    uint32_t r[8];
+    for (int j=(i+c)%2; j<Nd; j+=2)
+    {
+        simdRandom(rng,r);
+        int32_t *site=batchSite(b,i,j);
+        for (int w=0; w<BATCH_WIDTH; ++w)
+        {
+            int s=site[w-stride]+site[w+stride]+site[w-BATCH_WIDTH]+site[w+BATCH_WIDTH];
+            int old=site[w];
+            site[w]=(int32_t(r[w]>>1)<threshold[s*BATCH_WIDTH+w]);
+            delta[w]+=(site[w]-old)*s;
+        }
+    }
+#endif
+}
+
+
+/*
+ * This function takes the chains in the lanes of b T steps forward at once with the checkerboard schedule. Every
+ * vector operation updates the same site in all the lanes, each with the acceptance table of its own temperature; this
+ * keeps small lattices, whose sweeps are too short to split over threads, busy in the vector units. Rows are still
+ * split statically over the threads, each drawing from its own generator in rngs.
+ *
+ * Function Argument:
+ * b: the chains, with current ghosts
+ * luts: acceptance table of the chain in every lane, NULL for a lane holding no chain (which stays at 0)
+ * T: number fo steps
+ * rngs: one generator per OpenMP thread, from seedSimdRng
+ * deltas: output, the change of t() of every lane over the T steps
+ *
+ * */
+void oneChainsIsingBatched(BatchedLattice &b, const IsingLUT **luts, int T, std::vector<SimdRng> &rngs,
+                           double *deltas)
+{
+    int Nd=b.Nd;
+
+    // Empty lanes get threshold 0 and stay at 0
+    int32_t threshold[8*BATCH_WIDTH]={0};
+    for (int w=0; w<BATCH_WIDTH; ++w)
+    {
+        if (luts[w]==NULL)
+        {
+            continue;
+        }
+        for (int s=0; s<5; ++s)
+        {
+            threshold[s*BATCH_WIDTH+w]=int32_t(std::min(luts[w]->gibbs[s]*2147483648.0,2147483647.0));
+        }
+    }
+
+    int total[BATCH_WIDTH]={0};
+
+#pragma omp parallel
+    {
+        SimdRng &rng=rngs[omp_get_thread_num()];
+        int delta[BATCH_WIDTH]={0};
+
+        for (int t=0; t<T; ++t)
+        {
+            for (int c=0; c<2; ++c)
+            {
+#pragma omp for schedule(static)
+                for (int i=0; i<Nd; ++i)
+                {
+                    batchedRow(b,i,c,threshold,rng,delta);
+                    refreshBatchColumns(b,i);
+                }
+
+#pragma omp single
+                refreshBatchRows(b);
+            }
+        }
+
+#pragma omp critical
+        for (int w=0; w<BATCH_WIDTH; ++w)
+        {
+            total[w]+=delta[w];
+        }
+    }
+
+    for (int w=0; w<BATCH_WIDTH; ++w)
+    {
+        deltas[w]=total[w];
+    }
+}
+
+
+/*
+ * Set up the batched model of side Nd, with no chain yet. The generators of the starting states and of the kernel are
+ * seeded with seed+rank, and the
+ * scratch lattice, the transfer of the states traded with other processes and the map from lanes to slots are set up
+ * once for all sweeps and exchanges; a process runs at most totalS chains, so the map has a lane for each.
+ * */
+void createBatchedIsing(BatchedIsingModel &m, int Nd, int totalS, int pack, int rank, unsigned seed)
+{
+    m.group=MPI_COMM_SELF;
+    m.schedule=EXCHANGE_NEIGHBOURS;
+    m.Nd=Nd;
+    m.chains=0;
+    int lanes=(totalS+BATCH_WIDTH-1)/BATCH_WIDTH*BATCH_WIDTH;
+    m.lanelut.assign(lanes,NULL);
+    m.laneslot.assign(lanes,-1);
+    m.initgen.seed(seed+rank);
+    seedSimdRng(m.simdrngs,omp_get_max_threads(),seed+rank);
+    createLattice(m.scratch,Nd,Nd);
+    createTransfer(m.transfer,m.scratch,pack);
+}
+
+void freeBatchedIsing(BatchedIsingModel &m)
+{
+    freeTransfer(m.transfer);
+    freeLattice(m.scratch);
+}
+
+/*
+ * The next free lane, a new batch being opened when the last one is full, with every site drawn uniformly from
+ * initgen whatever the temperature
+ * */
+void BatchedIsingModel::create(BatchedChain &x, double)
+{
+    x.batch=chains/BATCH_WIDTH;
+    x.lane=chains%BATCH_WIDTH;
+    chains+=1;
+    if (x.lane==0)
+    {
+        batches.push_back(BatchedLattice());
+        createBatch(batches.back(),Nd);
+        mags.resize(mags.size()+BATCH_WIDTH,0.0);
+    }
+
+    std::uniform_real_distribution<double> unif(0,1);
+    BatchedLattice &b=batches[x.batch];
+    for (int i=0; i<Nd; ++i)
+    {
+        int32_t *site=batchSite(b,i,0)+x.lane;
+        for (int j=0; j<Nd; ++j)
+        {
+            site[j*BATCH_WIDTH]=(unif(initgen)<0.5);
+        }
+    }
+    refreshBatch(b);
+}
+
+/*
+ * The lanes are freed with the batches, in freeBatchedIsing
+ * */
+void BatchedIsingModel::release(BatchedChain &)
+{
+}
+
+void BatchedIsingModel::buildTable(IsingLUT &lut, double temp)
+{
+    buildIsingLUT(lut,temp);
+}
+
+/*
+ * Sweep every batch once, each lane with the table of the slot now holding it, then sum the magnetizations of the
+ * lanes for observe. Exchanges only permute the lanes among the slots, so every lane holding a chain is mapped anew
+ * and the lanes past the last chain keep no table.
+ * */
+void BatchedIsingModel::sweepChains(std::vector<BatchedChain> &xs, std::vector<IsingLUT> &luts, int T,
+                                    std::vector<double> &energies)
+{
+    for (std::vector<BatchedChain>::size_type slot=0; slot<xs.size(); ++slot)
+    {
+        int k=xs[slot].batch*BATCH_WIDTH+xs[slot].lane;
+        lanelut[k]=&luts[slot];
+        laneslot[k]=int(slot);
+    }
+
+    for (std::vector<BatchedLattice>::size_type batch=0; batch<batches.size(); ++batch)
+    {
+        double deltas[BATCH_WIDTH];
+        oneChainsIsingBatched(batches[batch],&lanelut[batch*BATCH_WIDTH],T,simdrngs,deltas);
+        for (int w=0; w<BATCH_WIDTH; ++w)
+        {
+            if (laneslot[batch*BATCH_WIDTH+w]>=0)
+            {
+                energies[laneslot[batch*BATCH_WIDTH+w]]+=deltas[w];
+            }
+        }
+        batchMagnetizations(batches[batch],&mags[batch*BATCH_WIDTH]);
+    }
+}
+
+double BatchedIsingModel::energy(BatchedChain &x)
+{
+    double energies[BATCH_WIDTH];
+    batchEnergies(batches[x.batch],energies);
+    return energies[x.lane];
+}
+
+double BatchedIsingModel::logTarget(double energy, double temp)
+{
+    return logtargetIsing(energy,temp);
+}
+
+/*
+ * The lane is copied out to scratch, traded, and copied back in; its magnetization is taken from the lattice received
+ * */
+void BatchedIsingModel::trade(BatchedChain &x, int other, MPI_Comm comm)
+{
+    unpackLane(batches[x.batch],x.lane,scratch);
+    swapLattice(scratch,transfer,other,comm);
+    packLane(scratch,batches[x.batch],x.lane);
+    mags[x.batch*BATCH_WIDTH+x.lane]=magnetization(scratch);
+}
+
+/*
+ * Every process streams the observables of its slots to observables<rank>.bin and writes their statistics to
+ * summary<rank>.txt at the end
+ * */
+void BatchedIsingModel::begin(int id, int first, int S, const double *temps)
+{
+    openRecorder(recorder,true,id,first,S,temps);
+}
+
+void BatchedIsingModel::observe(int iter, int slot, int replica, int exchanged, double energy, BatchedChain &x)
+{
+    recordSlot(recorder,iter,slot,replica,exchanged,energy,mags[x.batch*BATCH_WIDTH+x.lane]);
+}
+
+void BatchedIsingModel::end(double seconds)
+{
+    closeRecorder(recorder,seconds);
+}
+
+
+/*
+ * Replica exchange on the 2D Ising lattice with the batched kernel, see temperedChainsIsing and BatchedIsingModel
+ * */
+void temperedChainsIsingBatched(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size, int pack,
+                                unsigned seed)
+{
+    BatchedIsingModel model;
+    createBatchedIsing(model,Nd,totalS,pack,rank,seed);
+    temperedChains(model,iterNum,totalS,T,temps,rank,size);
+    freeBatchedIsing(model);
+}
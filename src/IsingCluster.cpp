@@ -0,0 +1,191 @@
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <fstream>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <mpi.h>
+#include <omp.h>
+#include "Randomize.h"
+#include "Ising.h"
+#include "ArrayUtilities.h"
+
+
+/*
+ * Root of site k in the union-find forest, halving the path on the way up
+ * */
+int clusterFind(int *parent, int k)
+{
+    while (parent[k]!=k)
+    {
+        parent[k]=parent[parent[k]];
+        k=parent[k];
+    }
+    return k;
+}
+
+/*
+ * Merge the clusters of sites a and b; the smaller root index becomes the root
+ * */
+void clusterUnion(int *parent, int a, int b)
+{
+    int ra=clusterFind(parent,a);
+    int rb=clusterFind(parent,b);
+    if (ra<rb)
+    {
+        parent[rb]=ra;
+    } else if (rb<ra) {
+        parent[ra]=rb;
+    }
+}
+
+
+/*
+ * This function takes the Markov chain T steps forward with Swendsen-Wang cluster updates.
+ *
+ * With spins 0/1 the Gibbs kernels sample exp(2*temp*(t(x)+h*sum(x))). In +-1 spins this is an Ising model with
+ * coupling J=temp/2 and field H=temp*(2+h). Each step activates every bond between equal spins with probability
+ * 1-exp(-2J), labels the connected clusters, and sets each cluster C to 1 with probability 1/(1+exp(-2H|C|)), the
+ * field making the two orientations of a cluster unequally likely.
+ *
+ * The lattice rows are split in strips over the threads. Each thread activates the bonds of its strip and merges the
+ * clusters inside it with its own union-find, which touches no site of another strip. The vertical bonds leaving the
+ * last row of each strip are merged by one thread afterwards, and the cluster labels, sizes and new spins are then
+ * computed in parallel.
+ *
+ * Function Argument:
+ * x: the starting state, with current ghosts;
+ * T: number fo steps
+ * lut: acceptance table at the temperature of the chain
+ * return: change of t() over the T steps; clusters flip anywhere, so this is t() after minus t() before
+ *
+ * */
+double oneChainIsingCluster(PaddedLattice &x, int T, const IsingLUT &lut)
+{
+    double before=t(x);
+    int rows=x.rows;
+    int cols=x.cols;
+    int stride=x.stride;
+    int N=rows*cols;
+
+    // Shared by the threads, from the arena of the calling thread
+    ArenaScope scratch;
+    int *parent=scratch.allocate<int>(N);
+    int *label=scratch.allocate<int>(N);
+    int *clustersize=scratch.allocate<int>(N);
+    int *newspin=scratch.allocate<int>(N);
+    char *crossbond=scratch.allocate<char>(N);
+    unsigned seed=std::random_device{}();
+
+#pragma omp parallel
+    {
+        std::mt19937 gen(seed+omp_get_thread_num());
+        std::uniform_real_distribution<double> unif(0,1);
+        int threadid=omp_get_thread_num();
+        int numthreads=omp_get_num_threads();
+
+        // Partition the matrix in strips
+        int low=rows*threadid/numthreads;
+        int high=rows*(threadid+1)/numthreads;
+
+        for (int t=0; t<T; ++t)
+        {
+            for (int k=low*cols; k<high*cols; ++k)
+            {
+                parent[k]=k;
+            }
+
+            // Activate the bonds to the right and below every site; those leaving the strip are only recorded
+            for (int i=low; i<high; ++i)
+            {
+                int *row=latticeRow(x,i);
+                for (int j=0; j<cols; ++j)
+                {
+                    int k=i*cols+j;
+                    if ((row[j]==row[j+1])&&(unif(gen)<lut.bond))
+                    {
+                        clusterUnion(parent,k,i*cols+(j+1)%cols);
+                    }
+
+                    bool down=(row[j]==row[j+stride])&&(unif(gen)<lut.bond);
+                    if (i<high-1)
+                    {
+                        if (down)
+                        {
+                            clusterUnion(parent,k,k+cols);
+                        }
+                    } else {
+                        crossbond[k]=down;
+                    }
+                }
+            }
+
+#pragma omp barrier
+#pragma omp single
+            {
+                for (int th=0; th<numthreads; ++th)
+                {
+                    int i=rows*(th+1)/numthreads-1;
+                    if (i<rows*th/numthreads)
+                    {
+                        continue;
+                    }
+                    for (int j=0; j<cols; ++j)
+                    {
+                        if (crossbond[i*cols+j])
+                        {
+                            clusterUnion(parent,i*cols+j,((i+1)%rows)*cols+j);
+                        }
+                    }
+                }
+            }
+
+            // The forest is final: read the roots without writing to it
+            for (int k=low*cols; k<high*cols; ++k)
+            {
+                int r=k;
+                while (parent[r]!=r)
+                {
+                    r=parent[r];
+                }
+                label[k]=r;
+                clustersize[k]=0;
+            }
+
+#pragma omp barrier
+            for (int k=low*cols; k<high*cols; ++k)
+            {
+#pragma omp atomic
+                clustersize[label[k]]+=1;
+            }
+
+#pragma omp barrier
+            for (int k=low*cols; k<high*cols; ++k)
+            {
+                if (label[k]==k)
+                {
+                    newspin[k]=(unif(gen)<1/(1+exp(-2*lut.clusterfield*clustersize[k])));
+                }
+            }
+
+#pragma omp barrier
+            for (int i=low; i<high; ++i)
+            {
+                int *row=latticeRow(x,i);
+                for (int j=0; j<cols; ++j)
+                {
+                    row[j]=newspin[label[i*cols+j]];
+                }
+                row[-1]=row[cols-1];
+                row[cols]=row[0];
+            }
+
+#pragma omp barrier
+#pragma omp single
+            refreshGhostRows(x);
+        }
+    }
+    return t(x)-before;
+}
@@ -0,0 +1,353 @@
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <fstream>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <mpi.h>
+#include <omp.h>
+#include "Randomize.h"
+#include "Ising.h"
+#include "ArrayUtilities.h"
+#include "TemperedChains.h"
+
+
+/*
+ * Block-decompose a lattice of side Nd over the ranks of group, arranged as a px x py periodic Cartesian grid. Ranks
+ * are not reordered, so rank r of every group owns the same tile.
+ *
+ * Function Argument:
+ * tl: the tiling to fill
+ * group: communicator of the ranks sharing the lattice
+ * Nd: side length of the Ising lattice (even, and a multiple of px and py)
+ * px: number of tiles along the rows
+ * py: number of tiles along the columns
+ *
+ * */
+void createTiling(LatticeTiling &tl, MPI_Comm group, int Nd, int px, int py)
+{
+    if ((Nd%2!=0)||(Nd%px!=0)||(Nd%py!=0))
+    {
+        throw "Distributed lattice needs an even side length divisible by the process grid";
+    }
+    if ((Nd/px<2)||(Nd/py<2))
+    {
+        throw "Too many processes! One tile must have at least 2 rows and 2 columns";
+    }
+
+    int dims[2]={px,py};
+    int periods[2]={1,1};
+    MPI_Cart_create(group,2,dims,periods,0,&tl.cart);
+
+    int cartrank;
+    int coords[2];
+    MPI_Comm_rank(tl.cart,&cartrank);
+    MPI_Cart_coords(tl.cart,cartrank,2,coords);
+
+    tl.rows=Nd/px;
+    tl.cols=Nd/py;
+    tl.rowoffset=coords[0]*tl.rows;
+    tl.coloffset=coords[1]*tl.cols;
+    MPI_Cart_shift(tl.cart,0,1,&tl.up,&tl.down);
+    MPI_Cart_shift(tl.cart,1,1,&tl.left,&tl.right);
+
+    MPI_Type_vector(tl.rows,1,latticeStride(tl.cols),MPI_INT,&tl.column);
+    MPI_Type_commit(&tl.column);
+}
+
+void freeTiling(LatticeTiling &tl)
+{
+    MPI_Type_free(&tl.column);
+    MPI_Comm_free(&tl.cart);
+}
+
+
+/*
+ * Post the exchange of the edges of tile x with the four neighbouring tiles: the first and last rows and columns are
+ * sent and the ghosts receive the neighbours' edges. The message tag is the direction of travel (0 up, 1 down, 2 left,
+ * 3 right) so that a tile whose up and down (or left and right) neighbours coincide still matches them correctly.
+ *
+ * Function Argument:
+ * x: the tile
+ * tl: the tiling
+ * requests: output, the 8 requests to complete with MPI_Waitall
+ *
+ * */
+void startHaloExchange(PaddedLattice &x, LatticeTiling &tl, MPI_Request *requests)
+{
+    int rows=x.rows;
+    int cols=x.cols;
+
+    MPI_Irecv(latticeRow(x,-1),cols,MPI_INT,tl.up,1,tl.cart,&requests[0]);
+    MPI_Irecv(latticeRow(x,rows),cols,MPI_INT,tl.down,0,tl.cart,&requests[1]);
+    MPI_Irecv(latticeRow(x,0)-1,1,tl.column,tl.left,3,tl.cart,&requests[2]);
+    MPI_Irecv(latticeRow(x,0)+cols,1,tl.column,tl.right,2,tl.cart,&requests[3]);
+
+    MPI_Isend(latticeRow(x,0),cols,MPI_INT,tl.up,0,tl.cart,&requests[4]);
+    MPI_Isend(latticeRow(x,rows-1),cols,MPI_INT,tl.down,1,tl.cart,&requests[5]);
+    MPI_Isend(latticeRow(x,0),1,tl.column,tl.left,2,tl.cart,&requests[6]);
+    MPI_Isend(latticeRow(x,0)+cols-1,1,tl.column,tl.right,3,tl.cart,&requests[7]);
+}
+
+void exchangeHalo(PaddedLattice &x, LatticeTiling &tl)
+{
+    MPI_Request requests[8];
+    startHaloExchange(x,tl,requests);
+    MPI_Waitall(8,requests,MPI_STATUSES_IGNORE);
+}
+
+
+/*
+ * Gibbs update of the sites of colour c in columns jlo..jhi-1 of row i of a tile. Colours follow the global position
+ * of the site, (i+j)%2 on the whole lattice. Returns the change of t().
+ * */
+int gibbsTileRange(PaddedLattice &x, LatticeTiling &tl, int i, int jlo, int jhi, int c, const IsingLUT &lut, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<double> unif(0,1);
+    int *row=latticeRow(x,i);
+    int jst=jlo+(tl.rowoffset+tl.coloffset+i+jlo+c)%2;
+    int delta=0;
+
+    for (int j=jst; j<jhi; j+=2)
+    {
+        delta+=gibbsSite(row+j,x.stride,lut,unif(gen));
+    }
+    return delta;
+}
+
+
+/*
+ * This function takes the distributed Markov chain T steps forward with the checkerboard schedule. Each half-sweep
+ * updates the interior sites of the tile first, which do not read the ghosts, while the edges changed by the previous
+ * half-sweep are still in flight; it then waits for the halo exchange, updates the edge sites and posts the next
+ * exchange. The ghosts are current on entry and on return.
+ *
+ * Function Argument:
+ * x: the tile of the current rank
+ * tl: the tiling
+ * T: number fo steps
+ * lut: acceptance table at the temperature of the chain
+ * gens: one random generator per OpenMP thread
+ * return: change of t() of the tile over the T steps (summing it over the tiling gives the change of the lattice)
+ *
+ * */
+double sweepTile(PaddedLattice &x, LatticeTiling &tl, int T, const IsingLUT &lut, std::vector<std::mt19937> &gens)
+{
+    int rows=x.rows;
+    int cols=x.cols;
+    MPI_Request requests[8];
+    bool pending=false;
+    double delta=0;
+
+    for (int t=0; t<T; ++t)
+    {
+        for (int c=0; c<2; ++c)
+        {
+#pragma omp parallel for reduction(+:delta)
+            for (int i=1; i<rows-1; ++i)
+            {
+                delta+=gibbsTileRange(x,tl,i,1,cols-1,c,lut,gens[omp_get_thread_num()]);
+            }
+
+            if (pending)
+            {
+                MPI_Waitall(8,requests,MPI_STATUSES_IGNORE);
+            }
+
+#pragma omp parallel for reduction(+:delta)
+            for (int i=0; i<rows; ++i)
+            {
+                std::mt19937 &gen=gens[omp_get_thread_num()];
+                if ((i==0)||(i==rows-1))
+                {
+                    delta+=gibbsTileRange(x,tl,i,0,cols,c,lut,gen);
+                } else {
+                    delta+=gibbsTileRange(x,tl,i,0,1,c,lut,gen);
+                    delta+=gibbsTileRange(x,tl,i,cols-1,cols,c,lut,gen);
+                }
+            }
+
+            startHaloExchange(x,tl,requests);
+            pending=true;
+        }
+    }
+
+    if (pending)
+    {
+        MPI_Waitall(8,requests,MPI_STATUSES_IGNORE);
+    }
+    return delta;
+}
+
+
+/*
+ * Counterpart of t() for a distributed lattice: the pair counts of the tiles summed over the tiling
+ * */
+double tTile(PaddedLattice &x, LatticeTiling &tl)
+{
+    double local=t(x);
+    double result=0;
+    MPI_Allreduce(&local,&result,1,MPI_DOUBLE,MPI_SUM,tl.cart);
+    return result;
+}
+
+
+/*
+ * Set up the distributed model: the processes are split into groups of px*py consecutive ranks, each group tiling
+ * lattices of side Nd over a px x py grid. Every process seeds one generator per thread of its own.
+ * */
+void createDistributedIsing(DistributedIsingModel &m, int Nd, int px, int py, int pack, int rank)
+{
+    int groupsize=px*py;
+    MPI_Comm_split(MPI_COMM_WORLD,rank/groupsize,rank,&m.group);
+    m.schedule=EXCHANGE_NEIGHBOURS;
+    createTiling(m.tl,m.group,Nd,px,py);
+
+    m.gens.resize(omp_get_max_threads());
+    unsigned seed=std::random_device{}();
+    for (std::vector<std::mt19937>::size_type k=0; k<m.gens.size(); ++k)
+    {
+        m.gens[k].seed(seed+k);
+    }
+
+    // Only the shape of the tile matters to the transfer
+    PaddedLattice shape;
+    shape.rows=m.tl.rows;
+    shape.cols=m.tl.cols;
+    shape.stride=latticeStride(m.tl.cols);
+    shape.size=(m.tl.rows+2)*shape.stride;
+    shape.sites=NULL;
+    createTransfer(m.transfer,shape,pack);
+}
+
+void freeDistributedIsing(DistributedIsingModel &m)
+{
+    freeTransfer(m.transfer);
+    freeTiling(m.tl);
+    MPI_Comm_free(&m.group);
+}
+
+/*
+ * A new tile with every site drawn uniformly, whatever the temperature
+ * */
+void DistributedIsingModel::create(PaddedLattice &x, double)
+{
+    createLattice(x,tl.rows,tl.cols);
+    for (int i=0; i<tl.rows; ++i)
+    {
+        int *row=latticeRow(x,i);
+        for (int j=0; j<tl.cols; ++j)
+        {
+            row[j]=(unifrnd(0,1)<0.5);
+        }
+    }
+    exchangeHalo(x,tl);
+}
+
+void DistributedIsingModel::release(PaddedLattice &x)
+{
+    freeLattice(x);
+}
+
+void DistributedIsingModel::buildTable(IsingLUT &lut, double temp)
+{
+    buildIsingLUT(lut,temp);
+}
+
+/*
+ * Sweep the tiles of every chain; the changes of energy of the tiles are summed over the group
+ * */
+void DistributedIsingModel::sweepChains(std::vector<PaddedLattice> &xs, std::vector<IsingLUT> &luts, int T,
+                                        std::vector<double> &energies)
+{
+    for (std::vector<PaddedLattice>::size_type chains=0; chains<xs.size(); ++chains)
+    {
+        double localdelta=sweepTile(xs[chains],tl,T,luts[chains],gens);
+        double delta=0;
+        MPI_Allreduce(&localdelta,&delta,1,MPI_DOUBLE,MPI_SUM,tl.cart);
+        energies[chains]+=delta;
+    }
+}
+
+double DistributedIsingModel::energy(PaddedLattice &x)
+{
+    return tTile(x,tl);
+}
+
+double DistributedIsingModel::logTarget(double energy, double temp)
+{
+    return logtargetIsing(energy,temp);
+}
+
+/*
+ * Trade the tile with the process at the same position of the other group, then refresh the ghosts from the
+ * neighbouring tiles, which all traded at the same time
+ * */
+void DistributedIsingModel::trade(PaddedLattice &x, int other, MPI_Comm comm)
+{
+    swapLattice(x,transfer,other,comm);
+    exchangeHalo(x,tl);
+}
+
+/*
+ * The root of each group streams the observables of the group's slots to observables<group>.bin and writes their
+ * statistics to summary<group>.txt
+ * */
+void DistributedIsingModel::begin(int id, int first, int S, const double *temps)
+{
+    int grouprank;
+    MPI_Comm_rank(group,&grouprank);
+    openRecorder(recorder,grouprank==0,id,first,S,temps);
+}
+
+/*
+ * Magnetizations are summed over the tiles; the root records
+ * */
+void DistributedIsingModel::observe(int iter, int slot, int replica, int exchanged, double energy, PaddedLattice &x)
+{
+    double localmag=magnetization(x);
+    double mag=0;
+    MPI_Reduce(&localmag,&mag,1,MPI_DOUBLE,MPI_SUM,0,group);
+    recordSlot(recorder,iter,slot,replica,exchanged,energy,mag);
+}
+
+void DistributedIsingModel::end(double seconds)
+{
+    closeRecorder(recorder,seconds);
+}
+
+
+/*
+ *
+ * Distributed counterpart of temperedChainsIsing: each lattice is split over a group of px*py MPI processes, and the
+ * groups take the place of the processes in the replica exchange (see DistributedIsingModel and temperedChains).
+ * Group g runs chains g*S..(g+1)*S-1, every process of the group holding its tile of each of them. An exchange
+ * between two groups is carried out tile by tile.
+ *
+ * Function Arguments:
+ * iterNum: number of iterations
+ * totalS: total number of parallel chains (each group may run more than one chain)
+ * Nd: side length of the Ising lattice
+ * T: number of steps each iteration
+ * temps: temperatures of the chains
+ * rank: rank of current MPI process
+ * size: number of concurrent MPI processes (a multiple of px*py)
+ * px: number of tiles along the rows
+ * py: number of tiles along the columns
+ * pack: 1 to send tiles to other groups one bit per site, 0 to send them as ints
+ *
+ * */
+void temperedChainsIsingDistributed(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size, int px, int py, int pack)
+{
+    if (size%(px*py)!=0)
+    {
+        throw "The number of processes must be a multiple of the process grid";
+    }
+
+    DistributedIsingModel model;
+    createDistributedIsing(model,Nd,px,py,pack,rank);
+    temperedChains(model,iterNum,totalS,T,temps,rank,size);
+    freeDistributedIsing(model);
+}
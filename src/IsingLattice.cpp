@@ -0,0 +1,320 @@
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdlib.h>
+#include <cstdint>
+#include <mpi.h>
+#include <omp.h>
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#endif
+#include "Ising.h"
+
+
+// Alignment in bytes of the lattice storage and of the start of every row
+#define LATTICE_ALIGNMENT 64
+
+// Size in bytes of a transparent huge page; lattices whose rows per thread span at least one are backed by them
+#define LATTICE_HUGEPAGE (2*1024*1024)
+
+
+// CPUs the threads of this process are pinned to, in order, see bindThreads; empty if they are not pinned
+static std::vector<int> threadcpus;
+
+
+/*
+ * Allocate a padded lattice of rows x cols sites in one aligned block. The rows are padded to a multiple of
+ * LATTICE_ALIGNMENT bytes, and one ghost row and column surround the lattice on each side. The sites are set to 0.
+ *
+ * Function Argument:
+ * p: the lattice to allocate
+ * rows: number of rows (side length of the Ising lattice, or height of a tile of it)
+ * cols: number of columns
+ *
+ * */
+void createLattice(PaddedLattice &p, int rows, int cols)
+{
+    p.rows=rows;
+    p.cols=cols;
+    p.stride=latticeStride(cols);
+    p.size=(rows+2)*p.stride;
+
+    // One more alignment block past the last ghost row lets vector kernels read whole blocks off the end of a row
+    int slack=LATTICE_ALIGNMENT/sizeof(int);
+    size_t bytes=(p.size+slack)*sizeof(int);
+
+    // Huge pages only when every thread owns at least one, or they would put the rows of several threads on one node
+    int threads=omp_get_max_threads();
+    bool huge=(bytes/threads>=LATTICE_HUGEPAGE);
+
+    void *block=NULL;
+    if (posix_memalign(&block,huge ? LATTICE_HUGEPAGE : LATTICE_ALIGNMENT,bytes)!=0)
+    {
+        throw "Could not allocate the Ising lattice";
+    }
+    p.sites=static_cast<int*>(block);
+
+#ifdef MADV_HUGEPAGE
+    if (huge)
+    {
+        madvise(block,bytes,MADV_HUGEPAGE);
+    }
+#endif
+
+    firstTouchLattice(p,slack);
+}
+
+/*
+ * Set the sites of a freshly allocated lattice to 0 from the threads that will sweep them, so that the pages of every
+ * row are placed on the NUMA node of the thread that owns it. Thread k of a team of n writes rows [rows*k/n,
+ * rows*(k+1)/n), the band of the strip kernel and of the thread team; the static schedule of the checkerboard kernel
+ * splits the rows nearly the same way, the bands moving by a few rows at most. The first thread also writes the ghost
+ * row above the lattice, the last one the ghost row below it and the slack.
+ *
+ * Function Argument:
+ * p: the lattice, allocated but never written
+ * slack: number of ints allocated past the last ghost row
+ *
+ * */
+void firstTouchLattice(PaddedLattice &p, int slack)
+{
+    int rows=p.rows;
+
+#pragma omp parallel
+    {
+        int k=omp_get_thread_num();
+        int n=omp_get_num_threads();
+        int low=rows*k/n;
+        int high=rows*(k+1)/n;
+
+        int *begin=latticeRow(p,(k==0) ? -1 : low)-1;
+        int *end=(k==n-1) ? p.sites+p.size+slack : latticeRow(p,high)-1;
+        std::fill(begin,end,0);
+    }
+}
+
+/*
+ * Row stride of a padded lattice of cols columns: the row and its two ghosts, rounded up to whole alignment blocks
+ * */
+int latticeStride(int cols)
+{
+    int perline=LATTICE_ALIGNMENT/sizeof(int);
+    return ((cols+2+perline-1)/perline)*perline;
+}
+
+void freeLattice(PaddedLattice &p)
+{
+    free(p.sites);
+    p.sites=NULL;
+}
+
+
+/*
+ * Pin the OpenMP threads of this process one per CPU when pin is 1. The processes of a node that may run on the same
+ * CPUs (the launcher bound them to the same socket, or bound nothing) share those CPUs out: the r-th of them pins its
+ * thread k to allowed CPU r*threads+k. CPUs are numbered socket by socket, so neighbouring bands of rows stay on the
+ * same socket, and since a thread keeps its number from one parallel region to the next, it stays next to the rows it
+ * placed in createLattice. Nothing is pinned if the allowed CPUs are too few to give every thread of these processes a
+ * CPU of its own, if the binding is left to the OpenMP runtime through OMP_PROC_BIND or OMP_PLACES, or outside Linux.
+ * Collective over MPI_COMM_WORLD.
+ *
+ * Function Argument:
+ * pin: 1 to pin the threads, 0 to leave them to the operating system
+ *
+ * */
+void bindThreads(int pin)
+{
+    threadcpus.clear();
+    std::vector<int> allowedcpus;
+    int threads=omp_get_max_threads();
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if ((pin==1)&&(getenv("OMP_PROC_BIND")==NULL)&&(getenv("OMP_PLACES")==NULL)
+        &&(sched_getaffinity(0,sizeof(allowed),&allowed)==0))
+    {
+        for (int cpu=0; cpu<CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu,&allowed))
+            {
+                allowedcpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+
+    // Processes of the node are grouped by the first CPU they may run on; every process takes part, pinning or not
+    MPI_Comm node;
+    MPI_Comm sharing;
+    MPI_Comm_split_type(MPI_COMM_WORLD,MPI_COMM_TYPE_SHARED,0,MPI_INFO_NULL,&node);
+    MPI_Comm_split(node,allowedcpus.empty() ? MPI_UNDEFINED : allowedcpus[0],0,&sharing);
+    if (sharing!=MPI_COMM_NULL)
+    {
+        int r;
+        int n;
+        MPI_Comm_rank(sharing,&r);
+        MPI_Comm_size(sharing,&n);
+        if (int(allowedcpus.size())>=n*threads)
+        {
+            threadcpus.assign(allowedcpus.begin()+r*threads,allowedcpus.begin()+(r+1)*threads);
+        }
+        MPI_Comm_free(&sharing);
+    }
+    MPI_Comm_free(&node);
+
+#pragma omp parallel
+    pinThread(omp_get_thread_num());
+}
+
+/*
+ * Pin the calling thread to the CPU of thread k, see bindThreads. Does nothing if the threads are not pinned.
+ * */
+void pinThread(int k)
+{
+#ifdef __linux__
+    if (threadcpus.empty())
+    {
+        return;
+    }
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(threadcpus[k%threadcpus.size()],&cpus);
+    pthread_setaffinity_np(pthread_self(),sizeof(cpus),&cpus);
+#endif
+}
+
+
+/*
+ * Copy the sites of the last row and column into the ghosts before the first ones and vice versa, so that the
+ * neighbours of every site, including the periodic ones, sit at offsets -1, +1, -stride and +stride.
+ * */
+void refreshHalo(PaddedLattice &p)
+{
+    int cols=p.cols;
+    for (int i=0; i<p.rows; ++i)
+    {
+        int *row=latticeRow(p,i);
+        row[-1]=row[cols-1];
+        row[cols]=row[0];
+    }
+    refreshGhostRows(p);
+}
+
+/*
+ * Copy the last row, ghost columns included, into the ghost row above the first one and the first row into the ghost
+ * row below the last one
+ * */
+void refreshGhostRows(PaddedLattice &p)
+{
+    int rows=p.rows;
+    int cols=p.cols;
+    std::copy(latticeRow(p,rows-1)-1,latticeRow(p,rows-1)+cols+1,latticeRow(p,-1)-1);
+    std::copy(latticeRow(p,0)-1,latticeRow(p,0)+cols+1,latticeRow(p,rows)-1);
+}
+
+
+/*
+ * Prepare the exchange of lattices shaped like p. The datatype covers the rows x cols sites from site (0,0), skipping
+ * the ghosts and the padding at the end of every row; the packed buffers hold one bit per site and are allocated here
+ * once, so swaps allocate nothing.
+ *
+ * Function Argument:
+ * tr: the transfer to set up
+ * p: a lattice of the shape to exchange
+ * packed: 1 to send one bit per site, 0 to send the sites in place as ints
+ *
+ * */
+void createTransfer(LatticeTransfer &tr, PaddedLattice &p, int packed)
+{
+    tr.packed=packed;
+    MPI_Type_vector(p.rows,p.cols,p.stride,MPI_INT,&tr.sites);
+    MPI_Type_commit(&tr.sites);
+
+    int words=packed ? (p.rows*p.cols+63)/64 : 0;
+    tr.sendbits.assign(words,0);
+    tr.recvbits.assign(words,0);
+}
+
+void freeTransfer(LatticeTransfer &tr)
+{
+    MPI_Type_free(&tr.sites);
+    tr.sendbits.clear();
+    tr.recvbits.clear();
+}
+
+
+/*
+ * Copy the sites of p in row-major order into bits, site k being bit k%64 of word k/64
+ * */
+void packSpins(PaddedLattice &p, uint64_t *bits)
+{
+    uint64_t word=0;
+    int k=0;
+    for (int i=0; i<p.rows; ++i)
+    {
+        int *row=latticeRow(p,i);
+        for (int j=0; j<p.cols; ++j)
+        {
+            word|=uint64_t(row[j]&1)<<(k%64);
+            ++k;
+            if (k%64==0)
+            {
+                bits[k/64-1]=word;
+                word=0;
+            }
+        }
+    }
+    if (k%64!=0)
+    {
+        bits[k/64]=word;
+    }
+}
+
+/*
+ * Inverse of packSpins; the ghosts of p are left as they are
+ * */
+void unpackSpins(const uint64_t *bits, PaddedLattice &p)
+{
+    int k=0;
+    for (int i=0; i<p.rows; ++i)
+    {
+        int *row=latticeRow(p,i);
+        for (int j=0; j<p.cols; ++j)
+        {
+            row[j]=int((bits[k/64]>>(k%64))&1);
+            ++k;
+        }
+    }
+}
+
+
+/*
+ * Trade the sites of p with the lattice of the same shape held by rank other of comm. The ghosts are not sent: the
+ * caller refreshes them afterwards (refreshHalo for a whole lattice, exchangeHalo for a tile).
+ *
+ * Function Argument:
+ * p: the lattice to trade, replaced by the one received
+ * tr: transfer set up for the shape of p
+ * other: rank to trade with
+ * comm: communicator of other
+ *
+ * */
+void swapLattice(PaddedLattice &p, LatticeTransfer &tr, int other, MPI_Comm comm)
+{
+    if (tr.packed)
+    {
+        int words=int(tr.sendbits.size());
+        packSpins(p,tr.sendbits.data());
+        MPI_Sendrecv(tr.sendbits.data(),words,MPI_UINT64_T,other,0,tr.recvbits.data(),words,MPI_UINT64_T,other,0,
+                     comm,MPI_STATUS_IGNORE);
+        unpackSpins(tr.recvbits.data(),p);
+    } else {
+        MPI_Sendrecv_replace(latticeRow(p,0),1,tr.sites,other,0,other,0,comm,MPI_STATUS_IGNORE);
+    }
+}
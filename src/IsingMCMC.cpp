@@ -12,485 +12,463 @@
 #include "Randomize.h"
 #include "Ising.h"
 #include "ArrayUtilities.h"
+#include "TemperedChains.h"
 
 
 /*
-*
-* This function runs totalS number of parallel chains each on a temperature level defined in temps.
-* Each MPI process is responsible for 1 or more chains in the pool.
-* Each chain is run iterNum number of iterations where each iteration consists of T number of steps
-* The chains communicates via MPI send and receive. temperedChains outputs result in the result array.
-*
-* Function Arguments:
-* iterNum: number of iterations
-* totalS: total number of parallel chains (each core may run more than one chain)
-* Nd: dimension of state space
-* T: number of steps each iteration
-* rank: rank of current MPI process
-* size: number of concurrent MPI processes
-*
-* */
-void temperedChainsIsing(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size, int kernel)
+ * Set up the 2D Ising model of side Nd run by kernel Kernel (see temperedChainsIsing). The generator of the starting
+ * states is seeded with seed+rank, and the datatype and buffers of the states traded with other processes are set up
+ * once for all exchanges.
+ * */
+template<int Kernel>
+void createSquareIsing(SquareIsingModel<Kernel> &m, int Nd, int tile, int pack, int rank, unsigned seed)
 {
-
-
-    // Each MPI process is assigned S chains to run
-    int S=totalS/size;
-
-    if (rank==size-1)
+    m.group=MPI_COMM_SELF;
+    m.schedule=EXCHANGE_NEIGHBOURS;
+    m.Nd=Nd;
+    m.tile=tile;
+    m.initgen.seed(seed+rank);
+
+    // Only the shape of the lattice matters to the transfer
+    PaddedLattice shape;
+    shape.rows=Nd;
+    shape.cols=Nd;
+    shape.stride=latticeStride(Nd);
+    shape.size=(Nd+2)*shape.stride;
+    shape.sites=NULL;
+    createTransfer(m.transfer, shape, pack);
+
+    if (Kernel==8)
     {
-        S=totalS/size+totalS%size;
+        createTeam(m.team, omp_get_max_threads(), std::random_device{}());
     }
+}
 
-    // Each MPI process stores results in partialresult array of S columns and iterNum rows
-    int **partialresult;
-    create2Dmemory(partialresult,iterNum,S);
-
-    // Each MPI process has a different seed
-    srand(unsigned(time(0))+rank);
-
-    // Each chain creates a new starting state from uniform sampling
-    int ***xs;
-    create3Dmemory(xs, S, Nd,Nd);
-
-
-
-    for (int chains=0; chains<S; ++chains)
+template<int Kernel>
+void freeSquareIsing(SquareIsingModel<Kernel> &m)
+{
+    freeTransfer(m.transfer);
+    if (Kernel==8)
     {
-        for (int i=0; i<Nd; ++i)
-        {
-            for (int j=0;j<Nd; ++j)
-            {
-                if (unifrnd(0,1)<0.5)
-                    xs[chains][i][j]=1;
-                else{
-                    xs[chains][i][j]=0;
-                }
-            }
-        }
+        freeTeam(m.team);
     }
+}
 
-
-
-
-    /* Define variables used in the loop */
-    int exchangetimes=0; // total number of exchange that occur
-    double originallog; // store value of log target in prev step
-    double proplog; // store value of log target of the proposal
-    int glbc1; // global idx of chain 1 to exchange
-    int glbc2; // global idx of chain 2 to exchange
-    int rank1; // processor that runs chain 1
-    int rank2; // processor that runs chain 2
-    int c1; // local idx of chain 1 to exchange
-    int c2; // local idx of chain 2 to exchange
-    double coin; // store value of coin toss
-    double accpt; // store value of acceptance ratio
-
-    for (int iter=0; iter<iterNum; ++iter){
-
-        for (int chains=0; chains<S; ++chains)
-        {
-            if (kernel==0)
-            {
-                oneChainIsing(xs[chains], T, Nd, temps[chains+rank*S]);
-            } else {
-                oneChainIsingChess(xs[chains], T, Nd, temps[chains+rank*S]);
-            }
-
-            partialresult[iter][chains]=t(xs[chains],Nd);
-        }
-
-        // Global index of the two chain to exchange positions
-        glbc1=iterNum % totalS;
-        glbc2=(iterNum+1) % totalS;
-        if (totalS==1)
-        {
-            glbc1=0;
-            glbc2=0;
-        }
-
-        // Which processors these two indexes belong to
-        rank1=glbc1/S;
-        rank2=glbc2/S;
-
-        // Current process is not involved in exchange
-        if ((rank1!=rank)&&(rank2!=rank))
+/*
+ * A new Nd x Nd lattice with every site drawn uniformly from initgen, whatever the temperature
+ * */
+template<int Kernel>
+void SquareIsingModel<Kernel>::create(PaddedLattice &x, double)
+{
+    std::uniform_real_distribution<double> unif(0,1);
+    createLattice(x, Nd, Nd);
+    for (int i=0; i<Nd; ++i)
+    {
+        int *row=latticeRow(x,i);
+        for (int j=0;j<Nd; ++j)
         {
-            continue;
-        }
-        // Both indexes to exchange belong to current process
-        else if (rank1==rank2){
-
-            // Convert global indexes to local indexes
-            c1=glbc1%S;
-            c2=glbc2%S;
-
-            // Compute acceptance ratio
-            originallog=logtargetIsing(xs[c1],Nd,temps[c1])+logtargetIsing(xs[c2],Nd,temps[c2]);
-            proplog=logtargetIsing(xs[c1],Nd,temps[c2])+logtargetIsing(xs[c2],Nd,temps[c1]);
-
-            accpt=exp(proplog-originallog);
-
-            // Determine if accept by toss a random coin
-            coin=unifrnd(0,1);
-            if (coin<accpt){
-                // We indeed accept the proposal
-                int **imp;
-                imp=xs[c1];
-                xs[c1]=xs[c2];
-                xs[c2]=imp;
-                exchangetimes+=1;
+            if (unif(initgen)<0.5)
+                row[j]=1;
+            else{
+                row[j]=0;
             }
         }
+    }
+    refreshHalo(x);
+}
 
-            // Indexes to exchange occur on two different processes
-        else {
-
-            if (rank == rank1){
-
-                int c1=glbc1%S;
-                double logtgtc1c1=logtargetIsing(xs[c1],Nd,temps[glbc1]);
-                double logtgtc1c2=logtargetIsing(xs[c1],Nd,temps[glbc2]);
-
-                int **xsc2;
-                create2Dmemory(xsc2,Nd,Nd);
-                int xsc21D[Nd*Nd];
+template<int Kernel>
+void SquareIsingModel<Kernel>::release(PaddedLattice &x)
+{
+    freeLattice(x);
+}
 
-                MPI_Recv(xsc21D,Nd*Nd,MPI_INT,rank2,0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                conv1Dto2D(xsc21D, xsc2, Nd, Nd);
+template<int Kernel>
+void SquareIsingModel<Kernel>::buildTable(IsingLUT &lut, double temp)
+{
+    buildIsingLUT(lut, temp);
+}
 
-                double logtgtc2c2=logtargetIsing(xsc2,Nd,temps[glbc2]);
-                double logtgtc2c1=logtargetIsing(xsc2,Nd,temps[glbc1]);
+template<int Kernel>
+double SquareIsingModel<Kernel>::sweep(PaddedLattice &x, int T, const IsingLUT &lut)
+{
+    if (Kernel==0)
+    {
+        return oneChainIsing(x, T, lut);
+    } else if (Kernel==4) {
+        return oneChainIsingCluster(x, T, lut);
+    } else if (Kernel==6) {
+        return oneChainIsingTemporal(x, T, lut, tile);
+    } else if (Kernel==8) {
+        return oneChainIsingTeam(team, x, T, lut);
+    }
+    return oneChainIsingChess(x, T, lut);
+}
 
+/*
+ * Take every chain of the process T steps forward, one after the other
+ * */
+template<int Kernel>
+void SquareIsingModel<Kernel>::sweepChains(std::vector<PaddedLattice> &xs, std::vector<IsingLUT> &luts, int T,
+                                           std::vector<double> &energies)
+{
+    for (std::vector<PaddedLattice>::size_type chains=0; chains<xs.size(); ++chains)
+    {
+        energies[chains]+=sweep(xs[chains], T, luts[chains]);
+    }
+}
 
-                originallog=logtgtc1c1+logtgtc2c2;
-                proplog=logtgtc1c2+logtgtc2c1;
+/*
+ * With the team kernel the sums over the lattice run on the team too, so that no OpenMP region is opened per
+ * iteration
+ * */
+template<int Kernel>
+double SquareIsingModel<Kernel>::energy(PaddedLattice &x)
+{
+    if (Kernel==8)
+    {
+        return runTeamJob(team, TEAM_ENERGY, x, NULL, 0);
+    }
+    return t(x);
+}
 
-                accpt=exp(proplog-originallog);
+template<int Kernel>
+double SquareIsingModel<Kernel>::magnetization(PaddedLattice &x)
+{
+    if (Kernel==8)
+    {
+        return runTeamJob(team, TEAM_MAGNETIZATION, x, NULL, 0);
+    }
+    return ::magnetization(x);
+}
 
+template<int Kernel>
+double SquareIsingModel<Kernel>::logTarget(double energy, double temp)
+{
+    return logtargetIsing(energy, temp);
+}
 
-                coin=unifrnd(0,1);
-                if (coin<accpt){
+template<int Kernel>
+void SquareIsingModel<Kernel>::trade(PaddedLattice &x, int other, MPI_Comm comm)
+{
+    swapLattice(x, transfer, other, comm);
+    refreshHalo(x);
+}
 
+/*
+ * Every process streams the observables of its slots to observables<rank>.bin and writes their statistics to
+ * summary<rank>.txt at the end
+ * */
+template<int Kernel>
+void SquareIsingModel<Kernel>::begin(int id, int first, int S, const double *temps)
+{
+    openRecorder(recorder, true, id, first, S, temps);
+}
 
-                    // We indeed accept the proposal, notify the other chain
-                    int accptstatus=1;
+template<int Kernel>
+void SquareIsingModel<Kernel>::observe(int iter, int slot, int replica, int exchanged, double energy, PaddedLattice &x)
+{
+    recordSlot(recorder, iter, slot, replica, exchanged, energy, magnetization(x));
+}
 
-                    MPI_Send(&accptstatus,1,MPI_INT,rank2,0,MPI_COMM_WORLD);
+template<int Kernel>
+void SquareIsingModel<Kernel>::end(double seconds)
+{
+    closeRecorder(recorder, seconds);
+}
 
-                    int xsc11D[Nd*Nd];
-                    conv2Dto1D(xs[c1],xsc11D,Nd,Nd);
 
-                    MPI_Send(xsc11D,Nd*Nd,MPI_INT,rank2,0,MPI_COMM_WORLD);
+/*
+ * Replica exchange on the 2D Ising lattice with kernel Kernel, see temperedChainsIsing
+ * */
+template<int Kernel>
+void temperedChainsSquare(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size, int tile, int pack,
+                          unsigned seed)
+{
+    SquareIsingModel<Kernel> model;
+    createSquareIsing(model, Nd, tile, pack, rank, seed);
+    temperedChains(model, iterNum, totalS, T, temps, rank, size);
+    freeSquareIsing(model);
+}
 
-                    deepcopy2Darray(xsc2,xs[c1], Nd, Nd);
+/*
+*
+* Replica exchange on the 2D Ising lattice: runs temperedChains on the SquareIsingModel of the kernel. Each kernel is a
+* separate instantiation, chosen here once. The multispin, vectorized and batched kernels run on models of their own,
+* MultispinIsingModel, SimdIsingModel and BatchedIsingModel, whose states are the lattices the kernels sweep.
+*
+* Function Arguments:
+* iterNum: number of iterations
+* totalS: total number of parallel chains (each core may run more than one chain)
+* Nd: dimension of state space
+* T: number of steps each iteration
+* temps: temperatures of the chains
+* rank: rank of current MPI process
+* size: number of concurrent MPI processes
+* kernel: Gibbs kernel, 0-strip, 1-checkerboard, 2-multispin checkerboard, 4-Swendsen-Wang clusters,
+*         5-vectorized checkerboard, 6-temporally blocked checkerboard, 7-checkerboard on batches of BATCH_WIDTH chains,
+*         8-checkerboard on a persistent thread team
+* tile: number of rows of the bands of the temporally blocked kernel
+* pack: 1 to send states to other processes one bit per site, 0 to send them as ints
+* seed: seed of the starting states and of the vectorized and batched kernels, to which each process adds its rank
+*
+* */
+void temperedChainsIsing(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size, int kernel, int tile, int pack,
+                         unsigned seed)
+{
+    if (kernel==0)
+    {
+        temperedChainsSquare<0>(iterNum, totalS, Nd, T, temps, rank, size, tile, pack, seed);
+    } else if (kernel==2) {
+        temperedChainsIsingMultispin(iterNum, totalS, Nd, T, temps, rank, size);
+    } else if (kernel==4) {
+        temperedChainsSquare<4>(iterNum, totalS, Nd, T, temps, rank, size, tile, pack, seed);
+    } else if (kernel==5) {
+        temperedChainsIsingSimd(iterNum, totalS, Nd, T, temps, rank, size, seed);
+    } else if (kernel==6) {
+        temperedChainsSquare<6>(iterNum, totalS, Nd, T, temps, rank, size, tile, pack, seed);
+    } else if (kernel==7) {
+        temperedChainsIsingBatched(iterNum, totalS, Nd, T, temps, rank, size, pack, seed);
+    } else if (kernel==8) {
+        temperedChainsSquare<8>(iterNum, totalS, Nd, T, temps, rank, size, tile, pack, seed);
+    } else {
+        temperedChainsSquare<1>(iterNum, totalS, Nd, T, temps, rank, size, tile, pack, seed);
+    }
+}
 
-                    exchangetimes+=1;
+/*
+ * Precompute the acceptance probabilities of the Ising kernels at temperature temp, so that no exponential is
+ * evaluated per site. With neighbour sum s (0..4) and external field h, a Gibbs update sets the site to 1 with
+ * probability gibbs[s]=exp(temp*(s+h))/(exp(temp*(s+h))+exp(-temp*(s+h))), and a Metropolis update flips a site
+ * at spin v with probability metropolis[v][s], the min(1,.) of the corresponding ratio. The cluster kernel activates
+ * bonds with probability bond and weighs clusters with clusterfield.
+ *
+ * Function Argument:
+ * lut: the table to fill
+ * temp: temperature of the Ising lattice
+ * field: external field h
+ *
+ * */
+void buildIsingLUT(IsingLUT &lut, double temp, double field)
+{
+    lut.temp=temp;
+    lut.field=field;
+    for (int s=0; s<5; ++s)
+    {
+        double e=temp*(s+field);
+        lut.gibbs[s]=exp(e)/(exp(e)+exp(-e));
+        lut.metropolis[0][s]=std::min(1.0,exp(2*e));
+        lut.metropolis[1][s]=std::min(1.0,exp(-2*e));
+    }
 
+    // In +-1 spins the kernels sample coupling temp/2 and field temp*(2+h), see oneChainIsingCluster
+    lut.bond=1-exp(-temp);
+    lut.clusterfield=temp*(2+field);
+}
 
-                } else {
 
-                    int accptstatus=0;
-                    MPI_Send(&accptstatus,1,MPI_INT,rank2,0,MPI_COMM_WORLD);
-                }
+/*
+ * Update row i of the lattice site by site from left to right, keeping the ghost columns of the row current: the last
+ * site sees the new value of the first one, as it would without ghosts. Returns the change of t().
+ * */
+int gibbsRow(PaddedLattice &x, int i, const IsingLUT &lut, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<double> unif(0,1);
+    int *row=latticeRow(x,i);
+    int cols=x.cols;
 
-            } else {
-                int c2=glbc2%S;
-                int accptstatus;
+    int delta=gibbsSite(row,x.stride,lut,unif(gen));
+    row[cols]=row[0];
+    for (int j=1; j<cols; ++j)
+    {
+        delta+=gibbsSite(row+j,x.stride,lut,unif(gen));
+    }
+    row[-1]=row[cols-1];
+    return delta;
+}
 
-                int xsc21D[Nd*Nd];
-                conv2Dto1D(xs[c2],xsc21D,Nd,Nd);
-                MPI_Send(xsc21D,Nd*Nd,MPI_INT,rank1,0,MPI_COMM_WORLD);
-                MPI_Recv(&accptstatus,1,MPI_INT,rank1,0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 
-                if (accptstatus==1)
-                {
+/*
+ * This function takes the Markov chain T steps forward. The parallelization used is
+ * the strip partitioning.
+ *
+ * Function Argument:
+ * x: the starting state, with current ghosts;
+ * T: number fo steps
+ * lut: acceptance table at the temperature of the chain
+ * return: change of t() over the T steps
+ *
+ * */
+double oneChainIsing(PaddedLattice &x, int T, const IsingLUT &lut)
+{
+    int Nd=x.rows;
+    unsigned seed=std::random_device{}();
+    double delta=0;
 
-                    int **xsc1;
-                    create2Dmemory(xsc1,Nd,Nd);
+#pragma omp parallel shared(x) reduction(+:delta)
+    {
+        std::mt19937 gen(seed+omp_get_thread_num());
+        int threadid = omp_get_thread_num();
+        int numthreads = omp_get_num_threads();
 
-                    int xsc11D[Nd*Nd];
-                    MPI_Recv(xsc11D,Nd*Nd,MPI_INT,rank1,0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                    conv1Dto2D(xsc11D,xsc1,Nd,Nd);
+        if (Nd/numthreads<=1)
+        {
+            throw "Too many threads! One thread must have at least 2 rows";
+        }
 
+        // Partition the matrix in strips
+        int low = Nd*threadid/numthreads;
+        int high=Nd*(threadid+1)/numthreads;
 
-                    deepcopy2Darray(xsc1,xs[c2], Nd,Nd);
+        for (int t=0; t<T; ++t)
+        {
+            // The schedule now is to update everything except the last row
+            for(int i=low; i<high-1; ++i)
+            {
+                delta+=gibbsRow(x,i,lut,gen);
+            }
 
+            // put a barrier here go ensure all threads update the last row on new values from neighboring regions;
+            // the first row is copied to the bottom ghost row for the last strip
+#pragma omp barrier
+#pragma omp single
+            refreshGhostRows(x);
 
+            delta+=gibbsRow(x,high-1,lut,gen);
 
-                    exchangetimes+=1;
-                }
-            }
+            // Put a barrier here to ensure iteration is synchronized each step
+#pragma omp barrier
+#pragma omp single
+            refreshGhostRows(x);
         }
-
-
     }
-
-
-
-    print2Darray(partialresult,iterNum,S,"output"+std::to_string(rank)+".txt");
-    free3Dmemory(xs, S, Nd,Nd);
+    return delta;
 }
 
+
 /*
- * This function takes the Markov chain T steps forward. The parallelization used is
- * the strip partitioning.
+ * This function takes the Markov chain T steps forward with the checkerboard schedule: all white sites, then all
+ * black ones, each half-sweep split by rows over the threads. The sites of one colour do not neighbour each other,
+ * so the neighbour sums of a row are gathered in one branch-free pass, then compared against uniform numbers drawn in
+ * bulk. The ghosts are refreshed once per half-sweep.
  *
  * Function Argument:
- * x: pointer to the starting state;
+ * x: the starting state, with current ghosts;
  * T: number fo steps
- * Nd: side length of the Ising lattice
- * temp: temperature of the Ising lattice
+ * lut: acceptance table at the temperature of the chain
+ * return: change of t() over the T steps
  *
  * */
-void oneChainIsing(int **x, int T, int Nd, double temp)
+double oneChainIsingChess(PaddedLattice &x, int T, const IsingLUT &lut)
 {
-#pragma omp parallel shared(x)
-    {
-        //int numthreads=2;
-        //for (int threadid=0; threadid<numthreads; ++threadid)
-        //{
-            for (int t=0; t<T; ++t)
-            {
-                int threadid = omp_get_thread_num();
-                int numthreads = omp_get_num_threads();
-
-                if (Nd/numthreads<=1)
-                {
-                    throw "Too many threads! One thread must have at least 2 rows";
-                }
+    int rows=x.rows;
+    int cols=x.cols;
+    int stride=x.stride;
+    unsigned seed=std::random_device{}();
+    double delta=0;
 
-                // Partition the matrix in strips
-                int low = Nd*threadid/numthreads;
-                int high=Nd*(threadid+1)/numthreads;
-
-                if (high>Nd)
-                {
-                    high=Nd;
-                }
+#pragma omp parallel reduction(+:delta)
+    {
+        std::mt19937 gen(seed+omp_get_thread_num());
+        std::uniform_real_distribution<double> unif(0,1);
+        ArenaScope scratch;
+        int *sums=scratch.allocate<int>((cols+1)/2);
+        double *u=scratch.allocate<double>((cols+1)/2);
 
-                // The schedule now is to update everything except the last row
-                for(int i=low; i<high-1; ++i)
+        for (int t=0; t<T; ++t)
+        {
+            // We specify that the chess board starts first row with white (colour 0)
+            for (int c=0; c<2; ++c)
+            {
+#pragma omp for schedule(static)
+                for (int i=0; i<rows; ++i)
                 {
-                    for(int j=0; j<Nd; ++j)
-                    {
-                        int leftj=j-1;
-                        int rightj=j+1;
-                        if (j==0)
-                        {
-                            leftj=Nd-1;
-                        }
-                        else if (j==(Nd-1))
-                        {
-                            rightj=0;
-                        }
-
-                        int upi=i-1;
-                        int downi=i+1;
-                        if (i==0)
-                        {
-                            upi=Nd-1;
-                        }else if (i==Nd-1)
-                        {
-                            downi=0;
-                        }
-
-                        double s=x[upi][j]+x[downi][j]+x[i][leftj]+x[i][rightj];
-                        double cond_p=exp(temp*s)/(exp(temp*s)+exp(-temp*s));
-                        if (unifrnd(0,1)<cond_p)
-                        {
-                            x[i][j]=1;
-                        } else{
-                            x[i][j]=0;
-                        }
-                    }
-               }
-
-                // put a barrier here go ensure all threads update the last row on new values from neighboring regions
-#pragma omp barrier
-
-                int i=high-1;
+                    int *row=latticeRow(x,i)+(i+c)%2;
+                    int n=(cols-(i+c)%2+1)/2;
 
-                for (int j=0;j<Nd;++j)
-                {
-                    int leftj=j-1;
-                    int rightj=j+1;
-                    if (j==0)
+                    for (int k=0; k<n; ++k)
                     {
-                        leftj=Nd-1;
+                        int *site=row+2*k;
+                        sums[k]=site[-stride]+site[stride]+site[-1]+site[1];
                     }
-                    else if (j==(Nd-1))
+                    for (int k=0; k<n; ++k)
                     {
-                        rightj=0;
+                        u[k]=unif(gen);
                     }
-
-                    int upi=i-1;
-                    int downi=i+1;
-                    if (i==0)
+                    int rowdelta=0;
+                    for (int k=0; k<n; ++k)
                     {
-                        upi=Nd-1;
-                    }else if (i==Nd-1)
-                    {
-                        downi=0;
+                        int old=row[2*k];
+                        row[2*k]=(u[k]<lut.gibbs[sums[k]]);
+                        rowdelta+=(row[2*k]-old)*sums[k];
                     }
+                    delta+=rowdelta;
 
-                    double s=x[upi][j]+x[downi][j]+x[i][leftj]+x[i][rightj];
-                    double cond_p=exp(temp*s)/(exp(temp*s)+exp(-temp*s));
-                    if (unifrnd(0,1)<cond_p)
-                    {
-                        x[i][j]=1;
-                    } else{
-                        x[i][j]=0;
-                    }
+                    int *full=latticeRow(x,i);
+                    full[-1]=full[cols-1];
+                    full[cols]=full[0];
                 }
 
-                // Put a barrier here to ensure iteration is synchronized each step
-#pragma omp barrier
-
+#pragma omp single
+                refreshGhostRows(x);
             }
-        //}
-
+        }
     }
+    return delta;
 }
 
-void oneChainIsingChess(int **x, int T, int Nd, double temp)
-{
-    // We specify that the chess board starts first row with white
-
-    // Update all white cells
-    #pragma omp parallel for
-    for (int i=0; i<Nd; ++i)
-    {
-        int jst=0;
-        if (i%2==1)
-        {
-            jst=1;
-        }
-
-        int upi=i-1;
-        int downi=i+1;
-        if (i==0)
-        {
-            upi=Nd-1;
-        }else if (i==Nd-1)
-        {
-            downi=0;
-        }
-
-        for (int j=jst; j<Nd; j=j+2)
-        {
-            int leftj=j-1;
-            int rightj=j+1;
-            if (j==0)
-            {
-                leftj=Nd-1;
-            }
-            else if (j==(Nd-1))
-            {
-                rightj=0;
-            }
-
-            double s=x[upi][j]+x[downi][j]+x[i][leftj]+x[i][rightj];
-            double cond_p=exp(temp*s)/(exp(temp*s)+exp(-temp*s));
-            if (unifrnd(0,1)<cond_p)
-            {
-                x[i][j]=1;
-            } else{
-                x[i][j]=0;
-            }
-        }
-    }
 
+/*
+ * Number of pairs of neighbouring sites both set to 1. Each pair is counted once from its left or upper site; the
+ * ghosts must be current. On a tile of a distributed lattice, this counts the pairs whose left or upper site the tile
+ * owns, so the tile counts add up to the lattice count.
+ * */
+double t(PaddedLattice &x)
+{
+    double result=0;
+    int stride=x.stride;
 
-    // Update all black cells
-    #pragma omp parallel for
-    for (int i=0; i<Nd; ++i)
+#pragma omp parallel for reduction(+:result)
+    for(int i=0; i<x.rows; ++i)
     {
-        int jst=1;
-        if (i%2==1)
-        {
-            jst=0;
-        }
-
-        int upi=i-1;
-        int downi=i+1;
-        if (i==0)
-        {
-            upi=Nd-1;
-        }else if (i==Nd-1)
-        {
-            downi=0;
-        }
-
-        for (int j=jst; j<Nd; j=j+2)
+        int *row=latticeRow(x,i);
+        int pairs=0;
+        for(int j=0; j<x.cols; ++j)
         {
-            int leftj=j-1;
-            int rightj=j+1;
-            if (j==0)
-            {
-                leftj=Nd-1;
-            }
-            else if (j==(Nd-1))
-            {
-                rightj=0;
-            }
-
-            double s=x[upi][j]+x[downi][j]+x[i][leftj]+x[i][rightj];
-            double cond_p=exp(temp*s)/(exp(temp*s)+exp(-temp*s));
-            if (unifrnd(0,1)<cond_p)
-            {
-                x[i][j]=1;
-            } else{
-                x[i][j]=0;
-            }
+            pairs+=row[j]*(row[j+1]+row[j+stride]);
         }
+        result+=pairs;
     }
-
+    return result;
 }
 
-double t(int **x, int Nd)
+/*
+ * Magnetization of the state, the sum of the spins read as -1 and +1
+ * */
+double magnetization(PaddedLattice &x)
 {
     double result=0;
 
 #pragma omp parallel for reduction(+:result)
-    for(int i=0; i<Nd; ++i)
+    for(int i=0; i<x.rows; ++i)
     {
-        for(int j=0; j<Nd; ++j)
+        int *row=latticeRow(x,i);
+        int up=0;
+        for(int j=0; j<x.cols; ++j)
         {
-            int leftj=j-1;
-            int rightj=j+1;
-            if (j==0)
-            {
-                leftj=Nd-1;
-            }
-            else if (j==(Nd-1))
-            {
-                rightj=0;
-            }
-
-            int upi=i-1;
-            int downi=i+1;
-            if (i==0)
-            {
-                upi=Nd-1;
-            }else if (i==Nd-1)
-            {
-                downi=0;
-            }
-
-            result+=x[i][j]*(x[upi][j]+x[downi][j]+x[i][leftj]+x[i][rightj]);
+            up+=row[j];
         }
-
+        result+=2*up-x.cols;
     }
-    return 0.5*result;
+    return result;
 }
 
-double logtargetIsing(int **x, int Nd,double temp)
+/*
+ * Log of the target density, up to a constant, of a state whose t() is energy: the Gibbs kernels set a site to 1 with
+ * odds exp(2*temp*s), so they sample exp(2*temp*t(x)) (with no external field). Only this log is ever formed; the
+ * density itself overflows for large lattices.
+ * */
+double logtargetIsing(double energy, double temp)
 {
-    double result=0;
-
-    result=t(x,Nd);
-
-    result=exp(temp*result);
-    return result;
+    return 2*temp*energy;
 }
@@ -0,0 +1,78 @@
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <mpi.h>
+#include <omp.h>
+#include "Randomize.h"
+#include "Ising.h"
+#include "LatticeModels.h"
+#include "TemperedChains.h"
+
+
+/*
+ * Replica exchange on the D-dimensional model of spin type Spin with the side fixed to L (0 if not fixed)
+ * */
+template<int D, class Spin, int L>
+void temperedChainsCubicSide(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size)
+{
+    CubicModel<D,Spin,L> model;
+    model.group=MPI_COMM_SELF;
+    model.schedule=EXCHANGE_NEIGHBOURS;
+    model.Nd=Nd;
+    temperedChains(model, iterNum, totalS, T, temps, rank, size);
+}
+
+/*
+ * Run the D-dimensional model of spin type Spin. The common sides 16, 32 and 64 get their own instantiation of the
+ * kernel with the side fixed at compile time; other sides run the generic one.
+ * */
+template<int D, class Spin>
+void temperedChainsCubic(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size)
+{
+    if (Nd==16)
+    {
+        temperedChainsCubicSide<D,Spin,16>(iterNum, totalS, Nd, T, temps, rank, size);
+    } else if (Nd==32) {
+        temperedChainsCubicSide<D,Spin,32>(iterNum, totalS, Nd, T, temps, rank, size);
+    } else if (Nd==64) {
+        temperedChainsCubicSide<D,Spin,64>(iterNum, totalS, Nd, T, temps, rank, size);
+    } else {
+        temperedChainsCubicSide<D,Spin,0>(iterNum, totalS, Nd, T, temps, rank, size);
+    }
+}
+
+
+/*
+ * Replica exchange on one of the heat-bath lattice models, the lattice having side Nd in every dimension.
+ *
+ * Function Arguments:
+ * model: 1-3D Ising, 2-2D 3-state Potts, 3-3D 3-state Potts, 4-2D 4-state Potts, 5-2D Ising (heat-bath kernel)
+ * iterNum: number of iterations
+ * totalS: total number of parallel chains
+ * Nd: side length of the lattice
+ * T: number of steps each iteration
+ * temps: temperatures of the chains
+ * rank: rank of current MPI process
+ * size: number of concurrent MPI processes
+ *
+ * */
+void temperedChainsLattice(int model, int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size)
+{
+    if (model==1)
+    {
+        temperedChainsCubic<3,IsingSpins>(iterNum, totalS, Nd, T, temps, rank, size);
+    } else if (model==2) {
+        temperedChainsCubic<2,PottsSpins<3> >(iterNum, totalS, Nd, T, temps, rank, size);
+    } else if (model==3) {
+        temperedChainsCubic<3,PottsSpins<3> >(iterNum, totalS, Nd, T, temps, rank, size);
+    } else if (model==4) {
+        temperedChainsCubic<2,PottsSpins<4> >(iterNum, totalS, Nd, T, temps, rank, size);
+    } else if (model==5) {
+        temperedChainsCubic<2,IsingSpins>(iterNum, totalS, Nd, T, temps, rank, size);
+    } else {
+        throw "Unknown lattice model";
+    }
+}
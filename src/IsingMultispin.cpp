@@ -0,0 +1,360 @@
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <fstream>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <mpi.h>
+#include <omp.h>
+#include "Randomize.h"
+#include "Ising.h"
+#include "ArrayUtilities.h"
+#include "TemperedChains.h"
+
+
+// Bits of precision of the bit-sliced acceptance test
+#define MULTISPIN_PRECISION 24
+
+
+/*
+ * Allocate a packed lattice of side Nd (Nd must be even so the two colours alternate around the torus).
+ * */
+void createMultispin(MultispinLattice &p, int Nd)
+{
+    if (Nd%2!=0)
+    {
+        throw "Multispin lattice needs an even side length";
+    }
+    p.Nd=Nd;
+    p.half=Nd/2;
+    p.words=(p.half+63)/64;
+    p.bits.assign(2*Nd*p.words,0);
+}
+
+/*
+ * Pointer to the packed sites of colour c in row i
+ * */
+uint64_t *multispinRow(MultispinLattice &p, int c, int i)
+{
+    return p.bits.data()+(size_t(c)*p.Nd+i)*p.words;
+}
+
+
+/*
+ * Rotate a packed row of H bits by one site: out bit k receives in bit k-1 (shiftprev) or in bit k+1 (shiftnext),
+ * wrapping around the row. Bits past H in the last word stay zero.
+ * */
+void shiftprev(const uint64_t *in, uint64_t *out, int H, int W)
+{
+    uint64_t lastmask=(H%64==0) ? ~uint64_t(0) : ((uint64_t(1)<<(H%64))-1);
+    for (int q=0; q<W; ++q)
+    {
+        uint64_t carry=(q>0) ? (in[q-1]>>63) : ((in[W-1]>>((H-1)%64))&1);
+        out[q]=(in[q]<<1)|carry;
+    }
+    out[W-1]&=lastmask;
+}
+
+void shiftnext(const uint64_t *in, uint64_t *out, int H, int W)
+{
+    for (int q=0; q<W-1; ++q)
+    {
+        out[q]=(in[q]>>1)|(in[q+1]<<63);
+    }
+    out[W-1]=(in[W-1]>>1)|((in[0]&1)<<((H-1)%64));
+}
+
+
+/*
+ * Bit-sliced sum of four neighbour words: lane by lane, s=s0+2*s1+4*s2 counts the neighbours set to 1
+ * */
+inline void neighboursum(uint64_t a, uint64_t b, uint64_t c, uint64_t d, uint64_t &s0, uint64_t &s1, uint64_t &s2)
+{
+    uint64_t t1=a^b;
+    uint64_t c1=a&b;
+    uint64_t t2=c^d;
+    uint64_t c2=c&d;
+    uint64_t c3=t1&t2;
+    s0=t1^t2;
+    s1=c1^c2^c3;
+    s2=c1&c2;
+}
+
+
+/*
+ * Neighbour sums of the colour c sites of row i, bit-sliced into s0, s1, s2 (one word each per packed word of the row)
+ * */
+void multispinNeighbours(MultispinLattice &p, int c, int i, uint64_t *shifted, uint64_t *s0, uint64_t *s1, uint64_t *s2)
+{
+    int Nd=p.Nd;
+    int W=p.words;
+    const uint64_t *up=multispinRow(p,1-c,(i+Nd-1)%Nd);
+    const uint64_t *down=multispinRow(p,1-c,(i+1)%Nd);
+    const uint64_t *same=multispinRow(p,1-c,i);
+
+    // The other colour of the same row supplies one aligned and one shifted horizontal neighbour
+    if ((i+c)%2==0)
+    {
+        shiftprev(same,shifted,p.half,W);
+    } else {
+        shiftnext(same,shifted,p.half,W);
+    }
+
+    for (int q=0; q<W; ++q)
+    {
+        neighboursum(up[q],down[q],same[q],shifted[q],s0[q],s1[q],s2[q]);
+    }
+}
+
+
+/*
+ * This function takes the packed Markov chain T steps forward with the checkerboard schedule, 64 sites per word.
+ * Each site is set to 1 with probability lut.gibbs[s] as in oneChainIsingChess. The
+ * comparison of a uniform number against this probability is bit-sliced: each lane draws a MULTISPIN_PRECISION-bit
+ * integer spread over as many random words and compares it against the threshold of its neighbour sum. The change of
+ * energy of a word is read off the bit slices of its neighbour sums with popcounts, as in tMultispin.
+ *
+ * Function Argument:
+ * p: the packed lattice
+ * T: number fo steps
+ * lut: acceptance table at the temperature of the chain
+ * return: change of tMultispin() over the T steps
+ *
+ * */
+double sweepMultispin(MultispinLattice &p, int T, const IsingLUT &lut)
+{
+    // Thresholds of the acceptance test for neighbour sums 0..4. The compare only reads MULTISPIN_PRECISION bits, so a
+    // probability that rounds to 1 is clamped to the largest threshold that fits
+    uint64_t threshold[5];
+    for (int s=0; s<5; ++s)
+    {
+        threshold[s]=std::min(uint64_t(lut.gibbs[s]*double(uint64_t(1)<<MULTISPIN_PRECISION)),
+                              (uint64_t(1)<<MULTISPIN_PRECISION)-1);
+    }
+
+    int Nd=p.Nd;
+    int W=p.words;
+    unsigned seed=std::random_device{}();
+    double delta=0;
+
+#pragma omp parallel reduction(+:delta)
+    {
+        std::mt19937_64 gen(seed+omp_get_thread_num());
+        ArenaScope scratch;
+        uint64_t *shifted=scratch.allocate<uint64_t>(4*W);
+        uint64_t *s0=shifted+W;
+        uint64_t *s1=s0+W;
+        uint64_t *s2=s1+W;
+        uint64_t r[MULTISPIN_PRECISION];
+
+        for (int t=0; t<T; ++t)
+        {
+            for (int c=0; c<2; ++c)
+            {
+#pragma omp for
+                for (int i=0; i<Nd; ++i)
+                {
+                    multispinNeighbours(p,c,i,shifted,s0,s1,s2);
+                    uint64_t *row=multispinRow(p,c,i);
+
+                    for (int q=0; q<W; ++q)
+                    {
+                        delta-=__builtin_popcountll(row[q]&s0[q])+2*__builtin_popcountll(row[q]&s1[q])
+                               +4*__builtin_popcountll(row[q]&s2[q]);
+
+                        for (int b=0; b<MULTISPIN_PRECISION; ++b)
+                        {
+                            r[b]=gen();
+                        }
+
+                        uint64_t newbits=0;
+                        for (int s=0; s<5; ++s)
+                        {
+                            uint64_t mask=((s&1) ? s0[q] : ~s0[q])&((s&2) ? s1[q] : ~s1[q])&((s&4) ? s2[q] : ~s2[q]);
+
+                            // Lanes whose random integer is below threshold[s], from the most significant bit down
+                            uint64_t less=0;
+                            uint64_t equal=~uint64_t(0);
+                            for (int b=MULTISPIN_PRECISION-1; b>=0; --b)
+                            {
+                                if ((threshold[s]>>b)&1)
+                                {
+                                    less|=equal&~r[b];
+                                    equal&=r[b];
+                                } else {
+                                    equal&=~r[b];
+                                }
+                            }
+                            newbits|=mask&less;
+                        }
+                        row[q]=newbits;
+                    }
+
+                    // Clear the bits past the end of the row
+                    if (p.half%64!=0)
+                    {
+                        row[W-1]&=(uint64_t(1)<<(p.half%64))-1;
+                    }
+
+                    for (int q=0; q<W; ++q)
+                    {
+                        delta+=__builtin_popcountll(row[q]&s0[q])+2*__builtin_popcountll(row[q]&s1[q])
+                               +4*__builtin_popcountll(row[q]&s2[q]);
+                    }
+                }
+            }
+        }
+    }
+    return delta;
+}
+
+
+/*
+ * Packed counterpart of t(): every interacting pair has exactly one colour 0 site, so the energy is the sum over
+ * colour 0 sites of the spin times its neighbour sum, read off the bit slices with popcounts.
+ * */
+double tMultispin(MultispinLattice &p)
+{
+    double result=0;
+    int W=p.words;
+
+#pragma omp parallel reduction(+:result)
+    {
+        ArenaScope scratch;
+        uint64_t *shifted=scratch.allocate<uint64_t>(4*W);
+        uint64_t *s0=shifted+W;
+        uint64_t *s1=s0+W;
+        uint64_t *s2=s1+W;
+
+#pragma omp for
+        for (int i=0; i<p.Nd; ++i)
+        {
+            multispinNeighbours(p,0,i,shifted,s0,s1,s2);
+            uint64_t *row=multispinRow(p,0,i);
+            for (int q=0; q<W; ++q)
+            {
+                result+=__builtin_popcountll(row[q]&s0[q])+2*__builtin_popcountll(row[q]&s1[q])+4*__builtin_popcountll(row[q]&s2[q]);
+            }
+        }
+    }
+    return result;
+}
+
+
+/*
+ * Packed counterpart of magnetization()
+ * */
+double magnetizationMultispin(MultispinLattice &p)
+{
+    double up=0;
+    for (std::vector<uint64_t>::size_type q=0; q<p.bits.size(); ++q)
+    {
+        up+=__builtin_popcountll(p.bits[q]);
+    }
+    return 2*up-double(p.Nd)*p.Nd;
+}
+
+
+/*
+ * Set up the multispin model of side Nd. The generators of the kernel are drawn at every sweep, so only the shape of
+ * the lattice is kept.
+ * */
+void createMultispinIsing(MultispinIsingModel &m, int Nd)
+{
+    if (Nd%2!=0)
+    {
+        throw "Multispin lattice needs an even side length";
+    }
+    m.group=MPI_COMM_SELF;
+    m.schedule=EXCHANGE_NEIGHBOURS;
+    m.Nd=Nd;
+}
+
+/*
+ * A new packed lattice with every site drawn uniformly, whatever the temperature
+ * */
+void MultispinIsingModel::create(MultispinLattice &x, double)
+{
+    createMultispin(x,Nd);
+    for (int i=0; i<Nd; ++i)
+    {
+        for (int j=0; j<Nd; ++j)
+        {
+            if (unifrnd(0,1)<0.5)
+            {
+                int k=j/2;
+                multispinRow(x,(i+j)%2,i)[k/64]|=uint64_t(1)<<(k%64);
+            }
+        }
+    }
+}
+
+void MultispinIsingModel::release(MultispinLattice &x)
+{
+    std::vector<uint64_t>().swap(x.bits);
+}
+
+void MultispinIsingModel::buildTable(IsingLUT &lut, double temp)
+{
+    buildIsingLUT(lut,temp);
+}
+
+void MultispinIsingModel::sweepChains(std::vector<MultispinLattice> &xs, std::vector<IsingLUT> &luts, int T,
+                                      std::vector<double> &energies)
+{
+    for (std::vector<MultispinLattice>::size_type chains=0; chains<xs.size(); ++chains)
+    {
+        energies[chains]+=sweepMultispin(xs[chains],T,luts[chains]);
+    }
+}
+
+double MultispinIsingModel::energy(MultispinLattice &x)
+{
+    return tMultispin(x);
+}
+
+double MultispinIsingModel::logTarget(double energy, double temp)
+{
+    return logtargetIsing(energy,temp);
+}
+
+/*
+ * The packed words are the state on the wire as well, one bit per site
+ * */
+void MultispinIsingModel::trade(MultispinLattice &x, int other, MPI_Comm comm)
+{
+    MPI_Sendrecv_replace(x.bits.data(),int(x.bits.size()),MPI_UINT64_T,other,0,other,0,comm,MPI_STATUS_IGNORE);
+}
+
+/*
+ * Every process streams the observables of its slots to observables<rank>.bin and writes their statistics to
+ * summary<rank>.txt at the end
+ * */
+void MultispinIsingModel::begin(int id, int first, int S, const double *temps)
+{
+    openRecorder(recorder,true,id,first,S,temps);
+}
+
+void MultispinIsingModel::observe(int iter, int slot, int replica, int exchanged, double energy, MultispinLattice &x)
+{
+    recordSlot(recorder,iter,slot,replica,exchanged,energy,magnetizationMultispin(x));
+}
+
+void MultispinIsingModel::end(double seconds)
+{
+    closeRecorder(recorder,seconds);
+}
+
+
+/*
+ * Replica exchange on the 2D Ising lattice with the multispin kernel, see temperedChainsIsing and MultispinIsingModel
+ * */
+void temperedChainsIsingMultispin(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size)
+{
+    MultispinIsingModel model;
+    createMultispinIsing(model,Nd);
+    temperedChains(model,iterNum,totalS,T,temps,rank,size);
+}
@@ -0,0 +1,330 @@
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Ising.h"
+
+
+// Largest lag of the autocorrelations kept by OnlineStats
+#define OBSERVABLE_MAXLAG 256
+
+// The window of the autocorrelation time stops at the first lag W with W >= AUTOCORR_WINDOW*tau(W) (Sokal)
+#define AUTOCORR_WINDOW 5
+
+// Records per buffer of the observables stream
+#define OBSERVABLE_BUFFER 4096
+
+
+void createStats(OnlineStats &s)
+{
+    s.n=0;
+    s.mean=0;
+    s.m2=0;
+    s.shift=0;
+    s.sum=0;
+    s.head.assign(OBSERVABLE_MAXLAG,0);
+    s.tail.assign(OBSERVABLE_MAXLAG,0);
+    s.lagsum.assign(OBSERVABLE_MAXLAG+1,0);
+}
+
+/*
+ * Add sample x: one Welford step for the mean and variance, and the products of x with the up to OBSERVABLE_MAXLAG
+ * previous samples. The products are taken after subtracting the first sample, which keeps them small when the
+ * observable sits far from 0.
+ * */
+void addSample(OnlineStats &s, double x)
+{
+    s.n+=1;
+    double d=x-s.mean;
+    s.mean+=d/s.n;
+    s.m2+=d*(x-s.mean);
+
+    if (s.n==1)
+    {
+        s.shift=x;
+    }
+    double y=x-s.shift;
+    long t=s.n-1;
+    int maxlag=int(s.tail.size());
+
+    // Sample t-k sits in tail[(t-k)%maxlag] until sample t-k+maxlag overwrites it, after this loop for k=maxlag
+    s.lagsum[0]+=y*y;
+    for (int k=1; (k<=maxlag)&&(k<=t); ++k)
+    {
+        s.lagsum[k]+=y*s.tail[(t-k)%maxlag];
+    }
+    s.tail[t%maxlag]=y;
+    if (t<maxlag)
+    {
+        s.head[t]=y;
+    }
+    s.sum+=y;
+}
+
+double statsVariance(const OnlineStats &s)
+{
+    return (s.n>1) ? s.m2/(s.n-1) : 0;
+}
+
+/*
+ * Autocovariance at lag k (k<n, k<=OBSERVABLE_MAXLAG) with the usual 1/n normalisation. The sum of
+ * (y_t-mean)(y_{t-k}-mean) over t=k..n-1 is expanded into the lagged products, the sum of the samples without the
+ * first k and the sum without the last k.
+ * */
+double autocovariance(const OnlineStats &s, int k)
+{
+    long n=s.n;
+    int maxlag=int(s.tail.size());
+    double mu=s.sum/n;
+
+    double first=0;
+    double last=0;
+    for (int i=0; i<k; ++i)
+    {
+        first+=s.head[i];
+        last+=s.tail[(n-1-i)%maxlag];
+    }
+    return (s.lagsum[k]-mu*((s.sum-first)+(s.sum-last))+(n-k)*mu*mu)/n;
+}
+
+/*
+ * Integrated autocorrelation time tau=1+2*sum_k rho(k), summed up to the self-consistent window of Sokal: the first W
+ * with W >= AUTOCORR_WINDOW*tau(W), or the largest lag available. A sample of n correlated draws carries about n/tau
+ * independent ones.
+ * */
+double autocorrelationTime(const OnlineStats &s)
+{
+    if (s.n<2)
+    {
+        return 1;
+    }
+    double c0=autocovariance(s,0);
+    if (c0<=0)
+    {
+        return 1;
+    }
+
+    int maxlag=std::min(long(s.tail.size()),s.n-1);
+    double tau=1;
+    for (int k=1; k<=maxlag; ++k)
+    {
+        tau+=2*autocovariance(s,k)/c0;
+        if (k>=AUTOCORR_WINDOW*tau)
+        {
+            break;
+        }
+    }
+    return (tau>0) ? tau : 1;
+}
+
+double effectiveSamples(const OnlineStats &s)
+{
+    return s.n/autocorrelationTime(s);
+}
+
+void createSlotObservables(std::vector<SlotObservables> &obs, int slots)
+{
+    obs.resize(slots);
+    for (int k=0; k<slots; ++k)
+    {
+        createStats(obs[k].energy);
+        createStats(obs[k].magnetization);
+        obs[k].proposed=0;
+        obs[k].accepted=0;
+    }
+}
+
+
+/*
+ * Open the binary observables stream filenm and start its writer thread. The file starts with the characters ISOB,
+ * the int32 number of slots of this process and the int32 global index of the first one, and their temperatures as
+ * doubles; ObservableRecord structs follow.
+ *
+ * Function Argument:
+ * w: the stream to open
+ * filenm: name of the file
+ * temps: temperatures of all the slots
+ * slots: number of slots recorded by this process
+ * first: global index of its first slot
+ *
+ * */
+void openObservables(ObservableWriter &w, std::string filenm, const double *temps, int slots, int first)
+{
+    w.file.open(filenm,std::ios::binary);
+    if (!w.file)
+    {
+        throw "Could not open the observables file";
+    }
+
+    int32_t header[2]={slots,first};
+    w.file.write("ISOB",4);
+    w.file.write(reinterpret_cast<const char*>(header),sizeof(header));
+    w.file.write(reinterpret_cast<const char*>(temps+first),slots*sizeof(double));
+
+    w.filling.reserve(OBSERVABLE_BUFFER);
+    w.writing.reserve(OBSERVABLE_BUFFER);
+    w.pending=false;
+    w.done=false;
+    w.thread=std::thread(observableWriterLoop,&w);
+}
+
+/*
+ * Body of the writer thread: write each buffer handed over by flushObservables, until closeObservables
+ * */
+void observableWriterLoop(ObservableWriter *w)
+{
+    std::unique_lock<std::mutex> guard(w->lock);
+    while (true)
+    {
+        w->ready.wait(guard,[w]{return w->pending||w->done;});
+        if (!w->pending)
+        {
+            break;
+        }
+
+        // The chains only touch filling while this buffer is written
+        guard.unlock();
+        w->file.write(reinterpret_cast<const char*>(w->writing.data()),w->writing.size()*sizeof(ObservableRecord));
+        guard.lock();
+
+        w->writing.clear();
+        w->pending=false;
+        w->ready.notify_all();
+    }
+}
+
+/*
+ * Hand the records gathered so far to the writer thread, waiting for it to finish the previous buffer first
+ * */
+void flushObservables(ObservableWriter &w)
+{
+    std::unique_lock<std::mutex> guard(w.lock);
+    w.ready.wait(guard,[&w]{return !w.pending;});
+    std::swap(w.filling,w.writing);
+    w.pending=true;
+    w.ready.notify_all();
+}
+
+void closeObservables(ObservableWriter &w)
+{
+    flushObservables(w);
+    {
+        std::lock_guard<std::mutex> guard(w.lock);
+        w.done=true;
+    }
+    w.ready.notify_all();
+    w.thread.join();
+    w.file.close();
+}
+
+
+/*
+ * Record the state of one slot after an iteration: update the statistics of the slot and append a record to the
+ * stream.
+ *
+ * Function Argument:
+ * w: the observables stream
+ * obs: statistics of the slot
+ * iter: iteration
+ * slot: global index of the slot (its temperature)
+ * replica: replica now at the slot
+ * exchanged: 0 no exchange of the slot was proposed, 1 one was proposed and rejected, 2 one was accepted
+ * energy: t() of the state
+ * mag: magnetization of the state
+ *
+ * */
+void recordObservables(ObservableWriter &w, SlotObservables &obs, int iter, int slot, int replica, int exchanged,
+                       double energy, double mag)
+{
+    addSample(obs.energy,energy);
+    addSample(obs.magnetization,mag);
+    obs.proposed+=(exchanged>0);
+    obs.accepted+=(exchanged==2);
+
+    ObservableRecord r;
+    r.iter=iter;
+    r.temp=slot;
+    r.replica=replica;
+    r.exchanged=exchanged;
+    r.energy=energy;
+    r.magnetization=mag;
+    w.filling.push_back(r);
+    if (int(w.filling.size())>=OBSERVABLE_BUFFER)
+    {
+        flushObservables(w);
+    }
+}
+
+/*
+ * Write one line per slot with the mean, variance, autocorrelation time and effective sample size of the energy and
+ * the magnetization, the exchanges proposed and accepted, and the effective samples of the energy per second of
+ * sampling, the throughput the kernels are compared by.
+ *
+ * Function Argument:
+ * obs: statistics of the slots of this process
+ * temps: temperatures of all the slots
+ * first: global index of the first slot of this process
+ * seconds: wall time of the sampling
+ * filenm: name of the file
+ *
+ * */
+void printObservableSummary(std::vector<SlotObservables> &obs, const double *temps, int first, double seconds,
+                            std::string filenm)
+{
+    std::ofstream myfile (filenm);
+    myfile << "# slot temp samples meanE varE tauE essE meanM varM tauM essM proposed accepted essE/s" << std::endl;
+    for (std::vector<SlotObservables>::size_type k=0; k<obs.size(); ++k)
+    {
+        OnlineStats &e=obs[k].energy;
+        OnlineStats &m=obs[k].magnetization;
+        double esse=effectiveSamples(e);
+        myfile << first+k << ' ' << temps[first+k] << ' ' << e.n << ' '
+               << e.mean << ' ' << statsVariance(e) << ' ' << autocorrelationTime(e) << ' ' << esse << ' '
+               << m.mean << ' ' << statsVariance(m) << ' ' << autocorrelationTime(m) << ' ' << effectiveSamples(m) << ' '
+               << obs[k].proposed << ' ' << obs[k].accepted << ' ' << ((seconds>0) ? esse/seconds : 0) << std::endl;
+    }
+}
+
+
+/*
+ * Start recording the S slots first..first+S-1 of group id, see SlotRecorder. Nothing is recorded unless active.
+ * */
+void openRecorder(SlotRecorder &rec, bool active, int id, int first, int S, const double *temps)
+{
+    rec.active=active;
+    rec.id=id;
+    rec.first=first;
+    rec.temps=temps;
+    if (active)
+    {
+        openObservables(rec.writer,"observables"+std::to_string(id)+".bin",temps,S,first);
+        createSlotObservables(rec.obs,S);
+    }
+}
+
+/*
+ * Record local slot slot, see recordObservables
+ * */
+void recordSlot(SlotRecorder &rec, int iter, int slot, int replica, int exchanged, double energy, double mag)
+{
+    if (rec.active)
+    {
+        recordObservables(rec.writer,rec.obs[slot],iter,slot+rec.first,replica,exchanged,energy,mag);
+    }
+}
+
+void closeRecorder(SlotRecorder &rec, double seconds)
+{
+    if (rec.active)
+    {
+        closeObservables(rec.writer);
+        printObservableSummary(rec.obs,rec.temps,rec.first,seconds,"summary"+std::to_string(rec.id)+".txt");
+    }
+}
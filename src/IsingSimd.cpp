@@ -0,0 +1,420 @@
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <fstream>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <mpi.h>
+#include <omp.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "Randomize.h"
+#include "Ising.h"
+#include "ArrayUtilities.h"
+#include "TemperedChains.h"
+
+
+/*
+ * splitmix64 step, used to spread one seed over the generator states
+ * */
+uint64_t splitmix64(uint64_t &state)
+{
+    uint64_t z=(state+=0x9E3779B97F4A7C15ULL);
+    z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+    z=(z^(z>>27))*0x94D049BB133111EBULL;
+    return z^(z>>31);
+}
+
+
+/*
+ * Give each of count threads its own 4-lane generator. The states depend only on seed and the thread index, so a run
+ * with a fixed seed and thread count draws the same numbers.
+ * */
+void seedSimdRng(std::vector<SimdRng> &rngs, int count, uint64_t seed)
+{
+    rngs.resize(count);
+    uint64_t state=seed;
+    for (int k=0; k<count; ++k)
+    {
+        for (int q=0; q<4; ++q)
+        {
+            rngs[k].s0[q]=splitmix64(state);
+            rngs[k].s1[q]=splitmix64(state);
+        }
+    }
+}
+
+
+/*
+ * Next 8 32-bit random numbers from the 4 xorshift128+ lanes of rng, lane q giving numbers 2q (low half) and 2q+1
+ * (high half). Scalar reference of the AVX2 generator in simdRow.
+ * */
+void simdRandom(SimdRng &rng, uint32_t *out)
+{
+    for (int q=0; q<4; ++q)
+    {
+        uint64_t a=rng.s0[q];
+        uint64_t b=rng.s1[q];
+        rng.s0[q]=b;
+        a^=a<<23;
+        rng.s1[q]=a^b^(a>>17)^(b>>26);
+        uint64_t r=rng.s1[q]+b;
+        out[2*q]=uint32_t(r);
+        out[2*q+1]=uint32_t(r>>32);
+    }
+}
+
+
+/*
+ * Allocate a split lattice of side Nd (even, so that the colours alternate around the torus), its sites set to 0 by
+ * the threads that sweep them. One alignment block of slack past the last row lets the kernel read whole vectors off
+ * the end of a row.
+ * */
+void createSplit(SplitLattice &p, int Nd)
+{
+    if (Nd%2!=0)
+    {
+        throw "Split lattice needs an even side length";
+    }
+    p.Nd=Nd;
+    p.half=Nd/2;
+    p.stride=((SPLIT_PAD+p.half+1+SPLIT_PAD-1)/SPLIT_PAD)*SPLIT_PAD;
+    size_t plane=size_t(Nd+2)*p.stride;
+    p.sites=static_cast<int*>(alignedAllocate((2*plane+SPLIT_PAD)*sizeof(int)));
+
+#pragma omp parallel for schedule(static)
+    for (int i=-1; i<=Nd; ++i)
+    {
+        for (int c=0; c<2; ++c)
+        {
+            int *row=splitRow(p,c,i)-SPLIT_PAD;
+            std::fill(row,row+p.stride,0);
+        }
+    }
+    std::fill(p.sites+2*plane,p.sites+2*plane+SPLIT_PAD,0);
+}
+
+void freeSplit(SplitLattice &p)
+{
+    free(p.sites);
+    p.sites=NULL;
+}
+
+/*
+ * Copy the first and last sites of row i of colour c into the ghosts on the other side
+ * */
+void refreshSplitColumns(SplitLattice &p, int c, int i)
+{
+    int *row=splitRow(p,c,i);
+    row[-1]=row[p.half-1];
+    row[p.half]=row[0];
+}
+
+/*
+ * Copy the first and last rows of colour c, ghosts included, into the ghost rows on the other side
+ * */
+void refreshSplitRows(SplitLattice &p, int c)
+{
+    std::copy(splitRow(p,c,p.Nd-1)-1,splitRow(p,c,p.Nd-1)+p.half+1,splitRow(p,c,-1)-1);
+    std::copy(splitRow(p,c,0)-1,splitRow(p,c,0)+p.half+1,splitRow(p,c,p.Nd)-1);
+}
+
+void refreshSplit(SplitLattice &p)
+{
+    for (int c=0; c<2; ++c)
+    {
+        for (int i=0; i<p.Nd; ++i)
+        {
+            refreshSplitColumns(p,c,i);
+        }
+        refreshSplitRows(p,c);
+    }
+}
+
+
+/*
+ * Gibbs update of the half sites of one row of one colour of a split lattice, 8 sites per step. The neighbour sums of
+ * 8 consecutive sites are the aligned loads of the rows above and below and of the row of the other colour plus the
+ * load of that row shifted by one site, the acceptance thresholds are looked up with a lane permutation, and the 8
+ * sites are written back through a mask that only drops the sites past the end of the row. One draw of 8 random
+ * numbers covers the 8 sites of a step, lane w taking number w; each number is compared as 31 bits to the threshold.
+ *
+ * Without AVX2 the same generator and the same assignment of random numbers to sites are run in scalar code, so both
+ * builds give the same chain.
+ *
+ * Function Argument:
+ * row: site 0 of the row to update
+ * up, down: site 0 of the rows above and below, of the other colour
+ * other: site 0 of the same row of the other colour
+ * shift: +1 or -1, offset in other of the second horizontal neighbour
+ * half: number of sites in the row
+ * threshold: 8 thresholds, entry s being 2^31 times the probability of setting a site of neighbour sum s to 1
+ * rng: generator of the current thread
+ * return: change of t() over the row
+ *
+ * */
+int simdRow(int *row, const int *up, const int *down, const int *other, int shift, int half, const int32_t *threshold,
+            SimdRng &rng)
+{
+#ifdef __AVX2__
+    __m256i s0=_mm256_loadu_si256((const __m256i*)rng.s0);
+    __m256i s1=_mm256_loadu_si256((const __m256i*)rng.s1);
+    __m256i thr=_mm256_loadu_si256((const __m256i*)threshold);
+    __m256i lane=_mm256_setr_epi32(0,1,2,3,4,5,6,7);
+    __m256i one=_mm256_set1_epi32(1);
+    __m256i delta=_mm256_setzero_si256();
+
+    for (int k=0; k<half; k+=8)
+    {
+        // xorshift128+ on 4 lanes, 8 numbers of 31 bits
+        __m256i a=s0;
+        __m256i b=s1;
+        s0=b;
+        a=_mm256_xor_si256(a,_mm256_slli_epi64(a,23));
+        s1=_mm256_xor_si256(_mm256_xor_si256(a,b),_mm256_xor_si256(_mm256_srli_epi64(a,17),_mm256_srli_epi64(b,26)));
+        __m256i u=_mm256_srli_epi32(_mm256_add_epi64(s1,b),1);
+
+        __m256i sum=_mm256_add_epi32(_mm256_add_epi32(_mm256_load_si256((const __m256i*)(up+k)),
+                                                      _mm256_load_si256((const __m256i*)(down+k))),
+                                     _mm256_add_epi32(_mm256_load_si256((const __m256i*)(other+k)),
+                                                      _mm256_loadu_si256((const __m256i*)(other+k+shift))));
+        __m256i p=_mm256_permutevar8x32_epi32(thr,sum);
+        __m256i newsites=_mm256_and_si256(_mm256_cmpgt_epi32(p,u),one);
+        __m256i mask=_mm256_cmpgt_epi32(_mm256_set1_epi32(half-k),lane);
+        __m256i change=_mm256_and_si256(_mm256_sub_epi32(newsites,_mm256_load_si256((const __m256i*)(row+k))),mask);
+        delta=_mm256_add_epi32(delta,_mm256_mullo_epi32(change,sum));
+        _mm256_maskstore_epi32(row+k,mask,newsites);
+    }
+
+    _mm256_storeu_si256((__m256i*)rng.s0,s0);
+    _mm256_storeu_si256((__m256i*)rng.s1,s1);
+
+    int lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes,delta);
+    return lanes[0]+lanes[1]+lanes[2]+lanes[3]+lanes[4]+lanes[5]+lanes[6]+lanes[7];
+#else
+    int delta=0;
+    uint32_t r[8];
+    for (int k=0; k<half; k+=8)
+    {
+        simdRandom(rng,r);
+        for (int w=0; (w<8)&&(k+w<half); ++w)
+        {
+            int kw=k+w;
+            int s=up[kw]+down[kw]+other[kw]+other[kw+shift];
+            int old=row[kw];
+            row[kw]=(int32_t(r[w]>>1)<threshold[s]);
+            delta+=(row[kw]-old)*s;
+        }
+    }
+    return delta;
+#endif
+}
+
+
+/*
+ * This function takes the Markov chain T steps forward with the checkerboard schedule, updating the rows of one colour
+ * and then the other with simdRow. Rows are split statically over the threads, each drawing from its own generator in
+ * rngs, so a run is reproducible for a fixed seed and thread count.
+ *
+ * Function Argument:
+ * x: the starting state, with current ghosts;
+ * T: number fo steps
+ * lut: acceptance table at the temperature of the chain
+ * rngs: one generator per OpenMP thread, from seedSimdRng
+ * return: change of t() over the T steps
+ *
+ * */
+double oneChainIsingSimd(SplitLattice &x, int T, const IsingLUT &lut, std::vector<SimdRng> &rngs)
+{
+    int Nd=x.Nd;
+
+    int32_t threshold[8]={0};
+    for (int s=0; s<5; ++s)
+    {
+        threshold[s]=int32_t(std::min(lut.gibbs[s]*2147483648.0,2147483647.0));
+    }
+
+    double delta=0;
+
+#pragma omp parallel reduction(+:delta)
+    {
+        SimdRng &rng=rngs[omp_get_thread_num()];
+
+        for (int t=0; t<T; ++t)
+        {
+            for (int c=0; c<2; ++c)
+            {
+#pragma omp for schedule(static)
+                for (int i=0; i<Nd; ++i)
+                {
+                    delta+=simdRow(splitRow(x,c,i),splitRow(x,1-c,i-1),splitRow(x,1-c,i+1),splitRow(x,1-c,i),
+                                   ((i+c)%2==0) ? -1 : 1,x.half,threshold,rng);
+                    refreshSplitColumns(x,c,i);
+                }
+
+#pragma omp single
+                refreshSplitRows(x,c);
+            }
+        }
+    }
+    return delta;
+}
+
+
+/*
+ * Split counterpart of t(): every interacting pair has exactly one colour 0 site, so the energy is the sum over
+ * colour 0 sites of the spin times its neighbour sum
+ * */
+double tSplit(SplitLattice &p)
+{
+    double result=0;
+
+#pragma omp parallel for reduction(+:result)
+    for (int i=0; i<p.Nd; ++i)
+    {
+        const int *row=splitRow(p,0,i);
+        const int *up=splitRow(p,1,i-1);
+        const int *down=splitRow(p,1,i+1);
+        const int *other=splitRow(p,1,i);
+        int shift=(i%2==0) ? -1 : 1;
+        int pairs=0;
+        for (int k=0; k<p.half; ++k)
+        {
+            pairs+=row[k]*(up[k]+down[k]+other[k]+other[k+shift]);
+        }
+        result+=pairs;
+    }
+    return result;
+}
+
+/*
+ * Split counterpart of magnetization()
+ * */
+double magnetizationSplit(SplitLattice &p)
+{
+    double result=0;
+
+#pragma omp parallel for reduction(+:result)
+    for (int i=0; i<p.Nd; ++i)
+    {
+        int up=0;
+        for (int c=0; c<2; ++c)
+        {
+            const int *row=splitRow(p,c,i);
+            for (int k=0; k<p.half; ++k)
+            {
+                up+=row[k];
+            }
+        }
+        result+=2*up-p.Nd;
+    }
+    return result;
+}
+
+
+/*
+ * Set up the vectorized model of side Nd. The generators of the starting states and of the kernel are seeded with
+ * seed+rank.
+ * */
+void createSimdIsing(SimdIsingModel &m, int Nd, int rank, unsigned seed)
+{
+    if (Nd%2!=0)
+    {
+        throw "Split lattice needs an even side length";
+    }
+    m.group=MPI_COMM_SELF;
+    m.schedule=EXCHANGE_NEIGHBOURS;
+    m.Nd=Nd;
+    m.initgen.seed(seed+rank);
+    seedSimdRng(m.simdrngs,omp_get_max_threads(),seed+rank);
+}
+
+/*
+ * A new split lattice with every site drawn uniformly from initgen, whatever the temperature
+ * */
+void SimdIsingModel::create(SplitLattice &x, double)
+{
+    std::uniform_real_distribution<double> unif(0,1);
+    createSplit(x,Nd);
+    for (int i=0; i<Nd; ++i)
+    {
+        for (int j=0; j<Nd; ++j)
+        {
+            splitRow(x,(i+j)%2,i)[j/2]=(unif(initgen)<0.5);
+        }
+    }
+    refreshSplit(x);
+}
+
+void SimdIsingModel::release(SplitLattice &x)
+{
+    freeSplit(x);
+}
+
+void SimdIsingModel::buildTable(IsingLUT &lut, double temp)
+{
+    buildIsingLUT(lut,temp);
+}
+
+void SimdIsingModel::sweepChains(std::vector<SplitLattice> &xs, std::vector<IsingLUT> &luts, int T,
+                                 std::vector<double> &energies)
+{
+    for (std::vector<SplitLattice>::size_type chains=0; chains<xs.size(); ++chains)
+    {
+        energies[chains]+=oneChainIsingSimd(xs[chains],T,luts[chains],simdrngs);
+    }
+}
+
+double SimdIsingModel::energy(SplitLattice &x)
+{
+    return tSplit(x);
+}
+
+double SimdIsingModel::logTarget(double energy, double temp)
+{
+    return logtargetIsing(energy,temp);
+}
+
+/*
+ * Both planes travel whole, so the ghosts received are current
+ * */
+void SimdIsingModel::trade(SplitLattice &x, int other, MPI_Comm comm)
+{
+    int count=2*(x.Nd+2)*x.stride;
+    MPI_Sendrecv_replace(x.sites,count,MPI_INT,other,0,other,0,comm,MPI_STATUS_IGNORE);
+}
+
+/*
+ * Every process streams the observables of its slots to observables<rank>.bin and writes their statistics to
+ * summary<rank>.txt at the end
+ * */
+void SimdIsingModel::begin(int id, int first, int S, const double *temps)
+{
+    openRecorder(recorder,true,id,first,S,temps);
+}
+
+void SimdIsingModel::observe(int iter, int slot, int replica, int exchanged, double energy, SplitLattice &x)
+{
+    recordSlot(recorder,iter,slot,replica,exchanged,energy,magnetizationSplit(x));
+}
+
+void SimdIsingModel::end(double seconds)
+{
+    closeRecorder(recorder,seconds);
+}
+
+
+/*
+ * Replica exchange on the 2D Ising lattice with the vectorized kernel, see temperedChainsIsing and SimdIsingModel
+ * */
+void temperedChainsIsingSimd(int iterNum, int totalS, int Nd, int T, double *temps, int rank, int size, unsigned seed)
+{
+    SimdIsingModel model;
+    createSimdIsing(model,Nd,rank,seed);
+    temperedChains(model,iterNum,totalS,T,temps,rank,size);
+}
@@ -0,0 +1,233 @@
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mpi.h>
+#include <omp.h>
+#include "Ising.h"
+
+
+// Spins of a thread waiting at the team barrier before it yields its core (processes may share cores)
+#define TEAM_SPINS 4096
+
+
+/*
+ * Start a team of size threads, the caller being member 0, each member with its own generator seeded from seed
+ * */
+void createTeam(SpinTeam &team, int size, unsigned seed)
+{
+    team.size=std::max(1,size);
+    team.members.resize(team.size);
+    team.gens.resize(team.size);
+    for (int k=0; k<team.size; ++k)
+    {
+        team.members[k].sense=0;
+        team.members[k].result=0;
+        team.gens[k].seed(seed+k);
+    }
+    team.arrived.store(0);
+    team.sense.store(0);
+    team.job=-1;
+    team.x=NULL;
+    team.lut=NULL;
+    team.T=0;
+
+    for (int k=1; k<team.size; ++k)
+    {
+        team.workers.push_back(std::thread(teamWorker,&team,k));
+    }
+}
+
+void freeTeam(SpinTeam &team)
+{
+    if (!team.workers.empty())
+    {
+        team.job=TEAM_STOP;
+        teamBarrier(team,0);
+        for (std::vector<std::thread>::size_type k=0; k<team.workers.size(); ++k)
+        {
+            team.workers[k].join();
+        }
+        team.workers.clear();
+    }
+}
+
+
+/*
+ * Sense-reversing barrier: every member flips its own sense on arrival; the last one to arrive resets the count and
+ * publishes the new sense, which the others spin on. The writes a member made before the barrier are visible to all
+ * members after it.
+ * */
+void teamBarrier(SpinTeam &team, int k)
+{
+    int mine=1-team.members[k].sense;
+    team.members[k].sense=mine;
+
+    if (team.arrived.fetch_add(1,std::memory_order_acq_rel)==team.size-1)
+    {
+        team.arrived.store(0,std::memory_order_relaxed);
+        team.sense.store(mine,std::memory_order_release);
+    } else {
+        int spins=0;
+        while (team.sense.load(std::memory_order_acquire)!=mine)
+        {
+            if (++spins==TEAM_SPINS)
+            {
+                std::this_thread::yield();
+                spins=0;
+            }
+        }
+    }
+}
+
+/*
+ * Body of member k>0: wait for a job, run its share, and report back, until the team is stopped
+ * */
+void teamWorker(SpinTeam *team, int k)
+{
+    // Member k sweeps the rows that OpenMP thread k placed, so it runs where that thread does
+    pinThread(k);
+
+    while (true)
+    {
+        teamBarrier(*team,k);
+        if (team->job==TEAM_STOP)
+        {
+            return;
+        }
+        teamJob(*team,k);
+        teamBarrier(*team,k);
+    }
+}
+
+
+/*
+ * Gibbs update of the sites of colour c in row i of a lattice swept by the team. The row refreshes its own ghost
+ * columns, and the first and last rows the ghost row on the other side, so that no member has to wait for another to
+ * refresh the ghosts between half-sweeps. Returns the change of t().
+ * */
+int teamRow(PaddedLattice &x, int i, int c, const IsingLUT &lut, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<double> unif(0,1);
+    int rows=x.rows;
+    int cols=x.cols;
+    int *row=latticeRow(x,i);
+    int *mirror=NULL;
+    if (i==0)
+    {
+        mirror=latticeRow(x,rows);
+    } else if (i==rows-1) {
+        mirror=latticeRow(x,-1);
+    }
+
+    // Only the sites being updated are mirrored: the member owning the row across the edge reads the others
+    int delta=0;
+    for (int j=(i+c)%2; j<cols; j+=2)
+    {
+        delta+=gibbsSite(row+j,x.stride,lut,unif(gen));
+        if (mirror!=NULL)
+        {
+            mirror[j]=row[j];
+        }
+    }
+    row[-1]=row[cols-1];
+    row[cols]=row[0];
+    return delta;
+}
+
+/*
+ * Share of member k of the posted job, over the rows it owns; its result is left in members[k].result
+ * */
+void teamJob(SpinTeam &team, int k)
+{
+    PaddedLattice &x=*team.x;
+    int rows=x.rows;
+    int cols=x.cols;
+    int low=rows*k/team.size;
+    int high=rows*(k+1)/team.size;
+    double result=0;
+
+    if (team.job==TEAM_SWEEP)
+    {
+        for (int t=0; t<team.T; ++t)
+        {
+            for (int c=0; c<2; ++c)
+            {
+                for (int i=low; i<high; ++i)
+                {
+                    result+=teamRow(x,i,c,*team.lut,team.gens[k]);
+                }
+                teamBarrier(team,k);
+            }
+        }
+    } else if (team.job==TEAM_MAGNETIZATION) {
+        for (int i=low; i<high; ++i)
+        {
+            int *row=latticeRow(x,i);
+            int up=0;
+            for (int j=0; j<cols; ++j)
+            {
+                up+=row[j];
+            }
+            result+=2*up-cols;
+        }
+    } else if (team.job==TEAM_ENERGY) {
+        for (int i=low; i<high; ++i)
+        {
+            int *row=latticeRow(x,i);
+            int pairs=0;
+            for (int j=0; j<cols; ++j)
+            {
+                pairs+=row[j]*(row[j+1]+row[j+x.stride]);
+            }
+            result+=pairs;
+        }
+    }
+    team.members[k].result=result;
+}
+
+/*
+ * Run one job on the whole team from member 0 and return the sum of the results of the members
+ * */
+double runTeamJob(SpinTeam &team, int job, PaddedLattice &x, const IsingLUT *lut, int T)
+{
+    team.job=job;
+    team.x=&x;
+    team.lut=lut;
+    team.T=T;
+
+    teamBarrier(team,0);
+    teamJob(team,0);
+    teamBarrier(team,0);
+
+    double result=0;
+    for (int k=0; k<team.size; ++k)
+    {
+        result+=team.members[k].result;
+    }
+    return result;
+}
+
+
+/*
+ * This function takes the Markov chain T steps forward with the checkerboard schedule on a persistent team of
+ * threads. The team outlives the call, so a sweep costs no thread start-up or OpenMP region: the members are
+ * released by one barrier, meet at one spin barrier per half-sweep, and report with one more. Every member updates
+ * the same rows at every call, which keeps them in its cache from one sweep to the next.
+ *
+ * Function Argument:
+ * team: the team, from createTeam
+ * x: the starting state, with current ghosts;
+ * T: number fo steps
+ * lut: acceptance table at the temperature of the chain
+ * return: change of t() over the T steps
+ *
+ * */
+double oneChainIsingTeam(SpinTeam &team, PaddedLattice &x, int T, const IsingLUT &lut)
+{
+    return runTeamJob(team,TEAM_SWEEP,x,&lut,T);
+}
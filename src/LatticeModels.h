@@ -0,0 +1,403 @@
+#ifndef LATTICEMODELS_H
+#define LATTICEMODELS_H
+
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <mpi.h>
+#include <omp.h>
+#include "ArrayUtilities.h"
+#include "Randomize.h"
+#include "Ising.h"
+
+
+/*
+ * Periodic lattice of side^D sites. Sites are stored row-major, the last coordinate varying fastest, so the lattice is
+ * side^(D-1) lines of side contiguous sites. A site holds one of at most 256 states in a byte, so a sweep streams a
+ * quarter of the memory of int sites.
+ * */
+typedef uint8_t CubicSite;
+#define CUBIC_SITE_MPI_TYPE MPI_UINT8_T
+
+template<int D>
+struct CubicLattice
+{
+    int side;
+    int sites;
+    CubicSite *spins;
+};
+
+/*
+ * Heat-bath table of a D-dimensional model at one temperature. A site whose neighbours agree with value v on e bonds
+ * (e=0..2D) has weight weight[e]=exp(2*temp*e), up[e] being the probability weight[e]/(1+weight[e]) of the Ising spin
+ * 1 when e neighbours are 1.
+ * */
+template<int D>
+struct HeatBathLUT
+{
+    double temp;
+    double weight[2*D+1];
+    double up[2*D+1];
+};
+
+/*
+ * Ising spins 0/1. A bond counts when both of its sites are 1, so on the square lattice the energy is t() and the
+ * target exp(2*temp*energy) is the one of the 2D kernels.
+ * */
+struct IsingSpins
+{
+    static const int states=2;
+
+    static int bond(int a, int b)
+    {
+        return a*b;
+    }
+
+    // Spin read as -1/+1
+    static double value(int a)
+    {
+        return 2*a-1;
+    }
+
+    /*
+     * Heat-bath draw of a site with neighbours nb given a uniform u; adds the change of energy to delta
+     * */
+    template<int D>
+    static int heatBath(const int *nb, int old, const HeatBathLUT<D> &lut, double u, int &delta)
+    {
+        int s=0;
+        for (int k=0; k<2*D; ++k)
+        {
+            s+=nb[k];
+        }
+        int v=(u<lut.up[s]);
+        delta+=(v-old)*s;
+        return v;
+    }
+};
+
+/*
+ * Q-state Potts spins 0..Q-1. A bond counts when its two sites agree.
+ * */
+template<int Q>
+struct PottsSpins
+{
+    static const int states=Q;
+
+    static int bond(int a, int b)
+    {
+        return a==b;
+    }
+
+    // Projection on state 0: 1 for a site in state 0, -1/(Q-1) otherwise, so a uniform mixture sums to 0
+    static double value(int a)
+    {
+        return (a==0) ? 1 : -1.0/(Q-1);
+    }
+
+    template<int D>
+    static int heatBath(const int *nb, int old, const HeatBathLUT<D> &lut, double u, int &delta)
+    {
+        int count[Q]={0};
+        for (int k=0; k<2*D; ++k)
+        {
+            count[nb[k]]+=1;
+        }
+
+        double cumulative[Q];
+        double total=0;
+        for (int v=0; v<Q; ++v)
+        {
+            total+=lut.weight[count[v]];
+            cumulative[v]=total;
+        }
+
+        int v=0;
+        u*=total;
+        while ((v<Q-1)&&(u>=cumulative[v]))
+        {
+            ++v;
+        }
+        delta+=count[v]-count[old];
+        return v;
+    }
+};
+
+
+/*
+ * Side of the lattice: the template extent L when it is fixed at compile time, the one of x otherwise
+ * */
+template<int D, int L>
+inline int cubicSide(const CubicLattice<D> &x)
+{
+    return (L>0) ? L : x.side;
+}
+
+/*
+ * Allocate a lattice of side^D sites, all 0. The checkerboard schedule needs an even side so that the two colours
+ * alternate around the torus. The sites are zeroed line by line with the static schedule of oneChainHeatBath, so the
+ * pages of every line are placed on the NUMA node of the thread that sweeps it.
+ * */
+template<int D>
+void createCubic(CubicLattice<D> &x, int side)
+{
+    if (side%2!=0)
+    {
+        throw "Checkerboard lattice needs an even side length";
+    }
+    x.side=side;
+    x.sites=1;
+    for (int d=0; d<D; ++d)
+    {
+        x.sites*=side;
+    }
+    x.spins=static_cast<CubicSite*>(alignedAllocate(size_t(x.sites)));
+
+    int lines=x.sites/side;
+#pragma omp parallel for schedule(static)
+    for (int r=0; r<lines; ++r)
+    {
+        std::fill(x.spins+size_t(r)*side,x.spins+size_t(r+1)*side,CubicSite(0));
+    }
+}
+
+template<int D>
+void freeCubic(CubicLattice<D> &x)
+{
+    free(x.spins);
+    x.spins=NULL;
+}
+
+template<int D>
+void buildHeatBathLUT(HeatBathLUT<D> &lut, double temp)
+{
+    lut.temp=temp;
+    for (int e=0; e<=2*D; ++e)
+    {
+        lut.weight[e]=exp(2*temp*e);
+        lut.up[e]=1/(1+exp(-2*temp*e));
+    }
+}
+
+/*
+ * Neighbouring lines of line r (the line of the sites with the first D-1 coordinates of r): lines[2d] and lines[2d+1]
+ * point to the lines one step down and up coordinate d, with periodic wrap. Returns the parity of the coordinates of
+ * the line.
+ * */
+template<int D, int L>
+inline int cubicNeighbourLines(CubicLattice<D> &x, int r, CubicSite **lines)
+{
+    const int side=cubicSide<D,L>(x);
+    CubicSite *base=x.spins;
+    int parity=0;
+    int rest=r;
+    int step=1;
+    for (int d=D-2; d>=0; --d)
+    {
+        int coord=rest%side;
+        rest/=side;
+        parity+=coord;
+        int down=(coord==0) ? r+(side-1)*step : r-step;
+        int up=(coord==side-1) ? r-(side-1)*step : r+step;
+        lines[2*d]=base+size_t(down)*side;
+        lines[2*d+1]=base+size_t(up)*side;
+        step*=side;
+    }
+    return parity%2;
+}
+
+/*
+ * This function takes a D-dimensional chain of spin type Spin T steps forward with the heat-bath kernel on the
+ * checkerboard schedule: each half-sweep redraws the sites of one colour (parity of the sum of the coordinates) from
+ * their conditional distribution given the neighbours, in parallel over the lines. D, the number of spin states and,
+ * when L>0, the side are compile-time constants, so the neighbour loops and the heat-bath draw are unrolled and the
+ * wrap-around tests fold into constants.
+ *
+ * Function Argument:
+ * x: the starting state
+ * T: number fo steps
+ * lut: heat-bath table at the temperature of the chain
+ * return: change of the energy over the T steps
+ *
+ * */
+template<int D, class Spin, int L>
+double oneChainHeatBath(CubicLattice<D> &x, int T, const HeatBathLUT<D> &lut)
+{
+    const int side=cubicSide<D,L>(x);
+    int lines=x.sites/side;
+    unsigned seed=std::random_device{}();
+    double delta=0;
+
+#pragma omp parallel reduction(+:delta)
+    {
+        std::mt19937 gen(seed+omp_get_thread_num());
+        std::uniform_real_distribution<double> unif(0,1);
+
+        for (int t=0; t<T; ++t)
+        {
+            for (int c=0; c<2; ++c)
+            {
+#pragma omp for schedule(static)
+                for (int r=0; r<lines; ++r)
+                {
+                    CubicSite *around[2*D];
+                    int parity=cubicNeighbourLines<D,L>(x,r,around);
+                    CubicSite *line=x.spins+size_t(r)*side;
+                    int linedelta=0;
+
+                    for (int j=(parity+c)%2; j<side; j+=2)
+                    {
+                        int nb[2*D];
+                        for (int k=0; k<2*(D-1); ++k)
+                        {
+                            nb[k]=around[k][j];
+                        }
+                        nb[2*D-2]=line[(j==0) ? side-1 : j-1];
+                        nb[2*D-1]=line[(j==side-1) ? 0 : j+1];
+                        line[j]=Spin::template heatBath<D>(nb,line[j],lut,unif(gen),linedelta);
+                    }
+                    delta+=linedelta;
+                }
+            }
+        }
+    }
+    return delta;
+}
+
+/*
+ * Energy of the lattice: the number of bonds that count for the spin type, each bond taken once (towards the larger
+ * coordinate)
+ * */
+template<int D, class Spin, int L>
+double cubicEnergy(CubicLattice<D> &x)
+{
+    const int side=cubicSide<D,L>(x);
+    int lines=x.sites/side;
+    double result=0;
+
+#pragma omp parallel for reduction(+:result)
+    for (int r=0; r<lines; ++r)
+    {
+        CubicSite *around[2*D];
+        cubicNeighbourLines<D,L>(x,r,around);
+        CubicSite *line=x.spins+size_t(r)*side;
+        int bonds=0;
+        for (int j=0; j<side; ++j)
+        {
+            for (int d=0; d<D-1; ++d)
+            {
+                bonds+=Spin::bond(line[j],around[2*d+1][j]);
+            }
+            bonds+=Spin::bond(line[j],line[(j==side-1) ? 0 : j+1]);
+        }
+        result+=bonds;
+    }
+    return result;
+}
+
+template<int D, class Spin>
+double cubicMagnetization(CubicLattice<D> &x)
+{
+    double result=0;
+
+#pragma omp parallel for reduction(+:result)
+    for (int k=0; k<x.sites; ++k)
+    {
+        result+=Spin::value(x.spins[k]);
+    }
+    return result;
+}
+
+
+/*
+ * D-dimensional model of spin type Spin on lattices of side Nd, run by the heat-bath kernel, as a model of
+ * temperedChains (see TemperedChains.h). L>0 fixes the side at compile time and must then equal Nd. Every process
+ * holds its chains whole and records their observables like the 2D Ising models.
+ * */
+template<int D, class Spin, int L>
+struct CubicModel
+{
+    static_assert(Spin::states<=256, "Spin states do not fit in a CubicSite");
+
+    typedef CubicLattice<D> State;
+    typedef HeatBathLUT<D> Table;
+
+    MPI_Comm group;
+    int schedule;
+    int Nd;
+    SlotRecorder recorder;
+
+    void create(CubicLattice<D> &x, double)
+    {
+        createCubic(x,Nd);
+        for (int k=0; k<x.sites; ++k)
+        {
+            x.spins[k]=std::min(int(unifrnd(0,Spin::states)),Spin::states-1);
+        }
+    }
+
+    void release(CubicLattice<D> &x)
+    {
+        freeCubic(x);
+    }
+
+    void buildTable(HeatBathLUT<D> &lut, double temp)
+    {
+        buildHeatBathLUT(lut,temp);
+    }
+
+    double sweep(CubicLattice<D> &x, int T, const HeatBathLUT<D> &lut)
+    {
+        return oneChainHeatBath<D,Spin,L>(x,T,lut);
+    }
+
+    void sweepChains(std::vector<CubicLattice<D> > &xs, std::vector<HeatBathLUT<D> > &luts, int T,
+                     std::vector<double> &energies)
+    {
+        for (size_t chains=0; chains<xs.size(); ++chains)
+        {
+            energies[chains]+=sweep(xs[chains],T,luts[chains]);
+        }
+    }
+
+    double energy(CubicLattice<D> &x)
+    {
+        return cubicEnergy<D,Spin,L>(x);
+    }
+
+    double magnetization(CubicLattice<D> &x)
+    {
+        return cubicMagnetization<D,Spin>(x);
+    }
+
+    // The weights of buildHeatBathLUT are those of the target exp(2*temp*energy)
+    double logTarget(double energy, double temp)
+    {
+        return 2*temp*energy;
+    }
+
+    void trade(CubicLattice<D> &x, int other, MPI_Comm comm)
+    {
+        MPI_Sendrecv_replace(x.spins,x.sites,CUBIC_SITE_MPI_TYPE,other,0,other,0,comm,MPI_STATUS_IGNORE);
+    }
+
+    void begin(int id, int first, int S, const double *temps)
+    {
+        openRecorder(recorder,true,id,first,S,temps);
+    }
+
+    void observe(int iter, int slot, int replica, int exchanged, double energy, CubicLattice<D> &x)
+    {
+        recordSlot(recorder,iter,slot,replica,exchanged,energy,magnetization(x));
+    }
+
+    void end(double seconds)
+    {
+        closeRecorder(recorder,seconds);
+    }
+};
+
+#endif
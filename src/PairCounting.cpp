@@ -0,0 +1,155 @@
+#include <iostream>
+#include <vector>
+#include <fstream>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <mpi.h>
+#include <omp.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "decipher.h"
+#include "ArrayUtilities.h"
+
+
+// Bytes of a text read and counted at once
+#define PAIR_BLOCK (64<<20)
+
+
+/*
+ * Append to files the regular files at path: path itself if it is a file, every file below it (in name order) if it
+ * is a directory
+ * */
+void listSources(std::string path, std::vector<std::string> &files)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info)!=0)
+    {
+        throw "Cannot read a text to count";
+    }
+    if (!S_ISDIR(info.st_mode))
+    {
+        files.push_back(path);
+        return;
+    }
+
+    DIR *dir=opendir(path.c_str());
+    if (dir==NULL)
+    {
+        throw "Cannot read a text to count";
+    }
+    std::vector<std::string> names;
+    for (struct dirent *entry=readdir(dir); entry!=NULL; entry=readdir(dir))
+    {
+        std::string name=entry->d_name;
+        if ((name!=".")&&(name!=".."))
+        {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+
+    std::sort(names.begin(), names.end());
+    for (std::vector<std::string>::size_type k=0; k<names.size(); ++k)
+    {
+        listSources(path+"/"+names[k], files);
+    }
+}
+
+
+/*
+ * Add the byte pairs (text[i], text[i+1]) of the n bytes of text to the 256x256 histogram total, in parallel. Each
+ * thread counts a contiguous chunk into a private histogram, its last pair reading the first byte of the next chunk,
+ * so that no pair is lost or counted twice at a chunk boundary; the histograms are merged once the chunks are done.
+ * */
+void countBytePairs(const unsigned char *text, size_t n, std::vector<uint64_t> &total)
+{
+    if (n<2)
+    {
+        return;
+    }
+    size_t pairs=n-1;
+
+#pragma omp parallel
+    {
+        std::vector<uint32_t> local(256*256,0);
+        int threads=omp_get_num_threads();
+        int k=omp_get_thread_num();
+        size_t lo=pairs*k/threads;
+        size_t hi=pairs*(k+1)/threads;
+
+        for (size_t i=lo; i<hi; ++i)
+        {
+            local[(text[i]<<8)|text[i+1]]+=1;
+        }
+
+#pragma omp critical
+        for (int b=0; b<256*256; ++b)
+        {
+            total[b]+=local[b];
+        }
+    }
+}
+
+/*
+ * Count the character pairs of the texts at sources (files, or directories whose files are all counted) into counts,
+ * a numchar x numchar matrix of the current alphabet, adding to what counts holds. Each file is read in blocks of
+ * PAIR_BLOCK bytes, the pair across two blocks being counted on its own, and its byte pairs counted in parallel; the
+ * bytes are folded to symbols once at the end, pairs with a byte outside the alphabet being dropped. No pair spans two
+ * files. A count past the range of uint32_t saturates.
+ *
+ * Function Arguments:
+ * counts: the pair counts to add to
+ * numchar: number of characters
+ * sources: paths of the texts to count
+ *
+ * */
+void countPairs(Matrix<uint32_t> &counts, int numchar, const std::vector<std::string> &sources)
+{
+    std::vector<std::string> files;
+    for (std::vector<std::string>::size_type k=0; k<sources.size(); ++k)
+    {
+        listSources(sources[k], files);
+    }
+
+    std::vector<uint64_t> total(256*256,0);
+    std::vector<unsigned char> block(PAIR_BLOCK);
+    for (std::vector<std::string>::size_type f=0; f<files.size(); ++f)
+    {
+        std::ifstream fin(files[f], std::ifstream::binary);
+        bool first=true;
+        unsigned char last=0;
+        while (fin)
+        {
+            fin.read((char*)block.data(), PAIR_BLOCK);
+            size_t n=fin.gcount();
+            if (n==0)
+            {
+                break;
+            }
+            if (!first)
+            {
+                total[(last<<8)|block[0]]+=1;
+            }
+            countBytePairs(block.data(), n, total);
+            last=block[n-1];
+            first=false;
+        }
+    }
+
+    const Alphabet &a=currentAlphabet();
+    for (int b1=0; b1<256; ++b1)
+    {
+        for (int b2=0; b2<256; ++b2)
+        {
+            int s1=a.symbol[b1];
+            int s2=a.symbol[b2];
+            if ((s1!=ALPHABET_OUTSIDE)&&(s2!=ALPHABET_OUTSIDE)&&(s1<numchar)&&(s2<numchar))
+            {
+                uint64_t sum=counts[s1][s2]+total[(b1<<8)|b2];
+                counts[s1][s2]=uint32_t(std::min<uint64_t>(sum, UINT32_MAX));
+            }
+        }
+    }
+}
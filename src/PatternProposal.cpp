@@ -0,0 +1,279 @@
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <fstream>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <mpi.h>
+#include <omp.h>
+#include "decipher.h"
+#include "Randomize.h"
+#include "ArrayUtilities.h"
+
+
+
+/*
+ * Return the letter pattern of a word: the first distinct character becomes 'A', the second 'B' and so on, so that
+ * "that" and "high" both have pattern "ABCA".
+ * */
+std::string wordpattern(std::string word)
+{
+    std::map<char, char> seen;
+    std::string pattern="";
+
+    for (char const &c: word)
+    {
+        if (seen.count(c)==0)
+        {
+            char next='A'+seen.size();
+            seen[c]=next;
+        }
+        pattern+=seen[c];
+    }
+    return pattern;
+}
+
+/*
+ * Same as wordpattern for a word given as ciphered symbol indexes
+ * */
+std::string symbolpattern(std::vector<int> &word)
+{
+    std::string asstring="";
+    for (std::vector<int>::size_type k=0; k<word.size(); ++k)
+    {
+        asstring+=num2char(word[k]);
+    }
+    return wordpattern(asstring);
+}
+
+
+/*
+ * Index the dictionary by letter pattern. Each pattern maps to its dictionary words in sorted order.
+ *
+ * Function Arguments:
+ * g_dict: the dictionary with word as key and frequency ranking as value
+ * patterns: output, pattern to the list of dictionary words having it
+ *
+ * */
+void buildPatternIndex(std::map<std::string, int> &g_dict, std::map<std::string, std::vector<std::string> > &patterns)
+{
+    for (std::map<std::string, int>::iterator it=g_dict.begin(); it!=g_dict.end(); ++it)
+    {
+        patterns[wordpattern(it->first)].push_back(it->first);
+    }
+}
+
+
+/*
+ * Split the ciphered text into words using the current decipher key to tell letters from separators, and keep the
+ * distinct words of at least two symbols whose pattern occurs in the dictionary. Each word is picked by the pattern
+ * proposal with probability proportional to its number of occurrences.
+ *
+ * Function Arguments:
+ * code: the ciphered text as symbol indexes, ALPHABET_OUTSIDE for the characters outside the alphabet
+ * decipherkey: the current decipher key
+ * isletter: whether each deciphered symbol is alphabetic
+ * patterns: the dictionary pattern index
+ * cipherwords: output, the distinct ciphered words
+ * cipherwordsprob: output, probability of picking each ciphered word
+ *
+ * */
+void buildCipherWords(std::vector<int> &code, KeySymbol *decipherkey, bool *isletter,
+                      std::map<std::string, std::vector<std::string> > &patterns,
+                      std::vector<std::vector<int> > &cipherwords, std::vector<double> &cipherwordsprob)
+{
+    std::map<std::vector<int>, int> counts;
+    std::vector<int> word;
+
+    for (std::vector<int>::size_type i=0; i<=code.size(); ++i)
+    {
+        if ((i<code.size())&&(decipheredLetter(code[i],decipherkey,isletter)))
+        {
+            word.push_back(code[i]);
+        }
+        else if (word.size()>0)
+        {
+            if ((word.size()>=2)&&(patterns.count(symbolpattern(word))>0))
+            {
+                counts[word]+=1;
+            }
+            word.clear();
+        }
+    }
+
+    double total=0;
+    for (std::map<std::vector<int>, int>::iterator it=counts.begin(); it!=counts.end(); ++it)
+    {
+        cipherwords.push_back(it->first);
+        cipherwordsprob.push_back(it->second);
+        total+=it->second;
+    }
+    for (std::vector<double>::size_type k=0; k<cipherwordsprob.size(); ++k)
+    {
+        cipherwordsprob[k]/=total;
+    }
+}
+
+
+/*
+ * List the transpositions of the cipher key that make the ciphered word decipher to the dictionary word. Each
+ * ciphered symbol keeps the case it currently deciphers to. The transpositions are given on deciphered symbols
+ * (positions of the cipher key) and must be applied in order.
+ *
+ * Function Arguments:
+ * decipherkey: the current decipher key
+ * Nd: dimension of state space
+ * cipherword: the ciphered word
+ * dictword: the dictionary word, same pattern as cipherword
+ * swaps: output, the transpositions to apply
+ *
+ * */
+void patternswaps(KeySymbol *decipherkey, int Nd, std::vector<int> &cipherword, std::string dictword,
+                  std::vector<std::pair<int, int> > &swaps)
+{
+    KeySymbol dkey[KEY_SYMBOLS];
+    KeySymbol ckey[KEY_SYMBOLS];
+    deepcopy1Darray(decipherkey,dkey,Nd);
+    cipherkey2decipherkey(dkey,ckey,Nd);
+
+    swaps.clear();
+    for (std::vector<int>::size_type k=0; k<cipherword.size(); ++k)
+    {
+        int c=cipherword[k];
+        char current=num2char(dkey[c]);
+        char wanted=isupper(current) ? toupper(dictword[k]) : dictword[k];
+        int a=dkey[c];
+        int b=char2num(wanted);
+        if (a==b)
+        {
+            continue;
+        }
+
+        // Swap the ciphered symbols currently deciphering to a and b
+        int cb=ckey[b];
+        dkey[c]=b;
+        dkey[cb]=a;
+        ckey[a]=cb;
+        ckey[b]=c;
+        swaps.push_back(std::make_pair(a,b));
+    }
+}
+
+
+/*
+ * Apply transpositions of the cipher key, as listed by patternswaps, to a decipher key in place
+ * */
+void applyswaps(KeySymbol *decipherkey, int Nd, std::vector<std::pair<int, int> > &swaps)
+{
+    KeySymbol ckey[KEY_SYMBOLS];
+    cipherkey2decipherkey(decipherkey,ckey,Nd);
+
+    for (std::vector<std::pair<int, int> >::size_type k=0; k<swaps.size(); ++k)
+    {
+        int a=swaps[k].first;
+        int b=swaps[k].second;
+        int ca=ckey[a];
+        int cb=ckey[b];
+        decipherkey[ca]=b;
+        decipherkey[cb]=a;
+        ckey[a]=cb;
+        ckey[b]=ca;
+    }
+}
+
+
+/*
+ * Draw a proposal from the mixture of the dictionary pattern kernel (probability patternprob) and uniform
+ * transpositions. The pattern kernel picks a frequent ciphered word and a dictionary word of the same letter pattern,
+ * then reassigns the key so that the ciphered word deciphers to it.
+ *
+ * The returned log(q(y->x)/q(x->y)) makes the move usable in a Metropolis-Hastings acceptance. For pattern moves it
+ * is computed from the chosen ciphered word only: the reverse move picks the same word and the dictionary word it
+ * currently deciphers to, if that word exists and undoes the move exactly. Uniform transpositions are symmetric.
+ *
+ * Function Arguments:
+ * decipherkey: the current decipher key
+ * Nd: dimension of state space
+ * cipherwords: the ciphered words from buildCipherWords
+ * cipherwordsprob: probability of picking each ciphered word
+ * patterns: the dictionary pattern index
+ * patternprob: probability of drawing from the pattern kernel
+ * swaps: output, the transpositions to apply to the cipher key, in order
+ * return: log proposal ratio, -inf if the move cannot be reversed
+ *
+ * */
+double patternProposal(KeySymbol *decipherkey, int Nd, std::vector<std::vector<int> > &cipherwords,
+                       std::vector<double> &cipherwordsprob, std::map<std::string, std::vector<std::string> > &patterns,
+                       double patternprob, std::vector<std::pair<int, int> > &swaps)
+{
+    double uniformprob=2.0/(Nd*(Nd-1));
+
+    if ((cipherwords.size()==0)||(unifrnd(0,1)>=patternprob))
+    {
+        int a=unifrndint(0,Nd-1);
+        int b=unifrndint(0,Nd-2);
+        if (b>=a)
+        {
+            b+=1;
+        }
+        swaps.clear();
+        swaps.push_back(std::make_pair(a,b));
+        return 0;
+    }
+
+    // Pick a ciphered word proportionally to its frequency
+    double coin=unifrnd(0,1);
+    std::vector<int>::size_type w=0;
+    while ((w+1<cipherwords.size())&&(coin>=cipherwordsprob[w]))
+    {
+        coin-=cipherwordsprob[w];
+        w+=1;
+    }
+    std::vector<std::string> &bucket=patterns[symbolpattern(cipherwords[w])];
+    std::string dictword=bucket[unifrndint(0,bucket.size()-1)];
+
+    patternswaps(decipherkey,Nd,cipherwords[w],dictword,swaps);
+    if (swaps.size()==0)
+    {
+        return 0;
+    }
+
+    double wordprob=patternprob*cipherwordsprob[w]/bucket.size();
+    double forward=wordprob;
+    double reverse=0;
+    if (swaps.size()==1)
+    {
+        forward+=(1-patternprob)*uniformprob;
+        reverse+=(1-patternprob)*uniformprob;
+    }
+
+    // Does the word x deciphers cipherwords[w] to lead back from y to x?
+    std::string currentword="";
+    for (std::vector<int>::size_type k=0; k<cipherwords[w].size(); ++k)
+    {
+        currentword+=tolower(num2char(decipherkey[cipherwords[w][k]]));
+    }
+    if (std::binary_search(bucket.begin(),bucket.end(),currentword))
+    {
+        KeySymbol ykey[KEY_SYMBOLS];
+        deepcopy1Darray(decipherkey,ykey,Nd);
+        applyswaps(ykey,Nd,swaps);
+
+        std::vector<std::pair<int, int> > backswaps;
+        patternswaps(ykey,Nd,cipherwords[w],currentword,backswaps);
+        applyswaps(ykey,Nd,backswaps);
+
+        if (std::equal(ykey,ykey+Nd,decipherkey))
+        {
+            reverse+=wordprob;
+        }
+    }
+
+    if (reverse==0)
+    {
+        return -INFINITY;
+    }
+    return log(reverse/forward);
+}
@@ -0,0 +1,231 @@
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <fstream>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <mpi.h>
+#include <omp.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "decipher.h"
+#include "ArrayUtilities.h"
+
+
+
+/*
+ * Switch the scorer of C to fixed point. log(R[i][j]) is stored as round(qscale*log(R[i][j])) in an int16 table, with
+ * qscale chosen so that the largest log count uses the full int16 range. The nonzero pairs of C are repeated with int16
+ * counts, by row and by column; a count that does not fit is split over several entries. Once quantized, logtarget
+ * and logtargetswapdelta use the integer backend.
+ *
+ * Function Arguments:
+ * C: the coded text pair counts to quantize
+ * R: word pair counts from reference
+ * Nd: dimension of state space
+ *
+ * */
+template<class Count>
+void quantizeScorer(SparseBigram<Count> &C, Matrix<Count> &R, int Nd)
+{
+    double maxlog=0;
+    for (int i=0; i<Nd; ++i)
+    {
+        for (int j=0; j<Nd; ++j)
+        {
+            maxlog=std::max(maxlog,log(double(R[i][j])));
+        }
+    }
+
+    C.qscale=(maxlog>0) ? 32767/maxlog : 1.0;
+    C.qlogR.resize(Nd*Nd);
+    for (int i=0; i<Nd; ++i)
+    {
+        for (int j=0; j<Nd; ++j)
+        {
+            C.qlogR[i*Nd+j]=int16_t(lround(C.qscale*log(double(R[i][j]))));
+        }
+    }
+
+    C.qrowptr.assign(1,0);
+    C.qrow.clear();
+    C.qcol.clear();
+    C.qcnt.clear();
+    for (int ci=0; ci<Nd; ++ci)
+    {
+        for (int k=C.rowptr[ci]; k<C.rowptr[ci+1]; ++k)
+        {
+            int remaining=C.cnt[k];
+            while (remaining>0)
+            {
+                int piece=std::min(remaining,32767);
+                C.qrow.push_back(ci);
+                C.qcol.push_back(C.col[k]);
+                C.qcnt.push_back(int16_t(piece));
+                remaining-=piece;
+            }
+        }
+        C.qrowptr.push_back(int(C.qcnt.size()));
+    }
+
+    C.qcolptr.assign(1,0);
+    C.qcolrow.clear();
+    C.qcolcnt.clear();
+    for (int cj=0; cj<Nd; ++cj)
+    {
+        for (int k=C.colptr[cj]; k<C.colptr[cj+1]; ++k)
+        {
+            int remaining=C.colcnt[k];
+            while (remaining>0)
+            {
+                int piece=std::min(remaining,32767);
+                C.qcolrow.push_back(C.row[k]);
+                C.qcolcnt.push_back(int16_t(piece));
+                remaining-=piece;
+            }
+        }
+        C.qcolptr.push_back(int(C.qcolcnt.size()));
+    }
+
+    C.quantized=true;
+}
+
+
+/*
+ * Dot product of two int16 arrays of length n accumulated exactly in 64 bits. Pairs of products are summed in 32 bits
+ * with pmaddwd (which cannot overflow) and widened before accumulation.
+ * */
+int64_t dotint16(const int16_t *a, const int16_t *b, int n)
+{
+    int64_t sum=0;
+    int k=0;
+
+#if defined(__AVX2__)
+    __m256i acc=_mm256_setzero_si256();
+    for (; k+16<=n; k+=16)
+    {
+        __m256i prod=_mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(a+k)),_mm256_loadu_si256((const __m256i*)(b+k)));
+        acc=_mm256_add_epi64(acc,_mm256_cvtepi32_epi64(_mm256_castsi256_si128(prod)));
+        acc=_mm256_add_epi64(acc,_mm256_cvtepi32_epi64(_mm256_extracti128_si256(prod,1)));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes,acc);
+    sum+=lanes[0]+lanes[1]+lanes[2]+lanes[3];
+#elif defined(__SSE2__)
+    __m128i acc=_mm_setzero_si128();
+    for (; k+8<=n; k+=8)
+    {
+        __m128i prod=_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(a+k)),_mm_loadu_si128((const __m128i*)(b+k)));
+        __m128i sign=_mm_srai_epi32(prod,31);
+        acc=_mm_add_epi64(acc,_mm_unpacklo_epi32(prod,sign));
+        acc=_mm_add_epi64(acc,_mm_unpackhi_epi32(prod,sign));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes,acc);
+    sum+=lanes[0]+lanes[1];
+#endif
+
+    for (; k<n; ++k)
+    {
+        sum+=int32_t(a[k])*int32_t(b[k]);
+    }
+    return sum;
+}
+
+
+/*
+ * Fixed point counterpart of logtarget: the quantized log counts of the deciphered pairs are gathered next to the
+ * int16 pair counts and the two arrays are multiplied with dotint16.
+ *
+ * Function Arguments:
+ * x: the current state of the chain
+ * Nd: dimension of state space
+ * C: word pair counts from coded text, quantized by quantizeScorer
+ * temp: temperature of current level
+ * return: target function value at the input state
+ *
+ * */
+template<int N, class Count>
+double logtargetquantized(KeySymbol *x, int Nd, SparseBigram<Count> &C, double temp)
+{
+    Nd=keySize<N>(Nd);
+    alignas(ARRAY_ALIGNMENT) KeySymbol xinv[keyCapacity<N>()];
+    cipherkey2decipherkey<N>(x,xinv,Nd);
+
+    int n=C.qcnt.size();
+    ArenaScope scratch;
+    int16_t *gathered=scratch.allocate<int16_t>(n);
+    for (int k=0; k<n; ++k)
+    {
+        gathered[k]=C.qlogR[xinv[C.qrow[k]]*Nd+xinv[C.qcol[k]]];
+    }
+
+    return temp*double(dotint16(gathered,C.qcnt.data(),n))/C.qscale;
+}
+
+
+/*
+ * Fixed point counterpart of logtargetswapdelta, over the same two rows and two columns of C. For each of them the
+ * quantized log counts of the pairs before and after the swap are gathered next to the int16 counts and both sides are
+ * multiplied with dotint16, as in logtargetquantized; the pairs of a column that lie in one of the two rows, already
+ * counted with the rows, get 0 on both sides. The difference is exact in integers and converted back once.
+ * */
+template<int N, class Count>
+double logtargetswapdeltaquantized(KeySymbol *x, KeySymbol *xinv, int Nd, SparseBigram<Count> &C, int a, int b)
+{
+    Nd=keySize<N>(Nd);
+    int u=x[a];
+    int v=x[b];
+    auto yinv=[&](int c){return (c==u) ? b : ((c==v) ? a : xinv[c]);};
+    const int16_t *q=C.qlogR.data();
+
+    ArenaScope scratch;
+    int64_t delta=0;
+    int swapped[2]={u,v};
+    for (int s=0; s<2; ++s)
+    {
+        int ci=swapped[s];
+        int lo=C.qrowptr[ci];
+        int n=C.qrowptr[ci+1]-lo;
+        int16_t *after=scratch.allocate<int16_t>(n);
+        int16_t *before=scratch.allocate<int16_t>(n);
+        for (int k=0; k<n; ++k)
+        {
+            int cj=C.qcol[lo+k];
+            after[k]=q[yinv(ci)*Nd+yinv(cj)];
+            before[k]=q[xinv[ci]*Nd+xinv[cj]];
+        }
+        delta+=dotint16(after,C.qcnt.data()+lo,n)-dotint16(before,C.qcnt.data()+lo,n);
+
+        int cj=swapped[s];
+        lo=C.qcolptr[cj];
+        n=C.qcolptr[cj+1]-lo;
+        after=scratch.allocate<int16_t>(n);
+        before=scratch.allocate<int16_t>(n);
+        for (int k=0; k<n; ++k)
+        {
+            int ri=C.qcolrow[lo+k];
+            bool counted=(ri==u)||(ri==v);
+            after[k]=counted ? 0 : q[xinv[ri]*Nd+yinv(cj)];
+            before[k]=counted ? 0 : q[xinv[ri]*Nd+xinv[cj]];
+        }
+        delta+=dotint16(after,C.qcolcnt.data()+lo,n)-dotint16(before,C.qcolcnt.data()+lo,n);
+    }
+
+    return double(delta)/C.qscale;
+}
+
+template void quantizeScorer<uint16_t>(SparseBigram<uint16_t> &C, Matrix<uint16_t> &R, int Nd);
+template void quantizeScorer<uint32_t>(SparseBigram<uint32_t> &C, Matrix<uint32_t> &R, int Nd);
+#define INSTANTIATE_QUANTIZED(N, Count) \
+    template double logtargetquantized<N,Count>(KeySymbol *x, int Nd, SparseBigram<Count> &C, double temp); \
+    template double logtargetswapdeltaquantized<N,Count>(KeySymbol *x, KeySymbol *xinv, int Nd, SparseBigram<Count> &C, \
+                                                         int a, int b);
+FOR_EACH_KEY_KERNEL(INSTANTIATE_QUANTIZED)
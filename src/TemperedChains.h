@@ -0,0 +1,250 @@
+#ifndef TEMPEREDCHAINS_H
+#define TEMPEREDCHAINS_H
+
+#include <iostream>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <mpi.h>
+#include <omp.h>
+#include "Randomize.h"
+
+
+// Pairs of slots proposed for exchange: neighbouring slots in turn, or the first slot with every other slot in turn
+#define EXCHANGE_NEIGHBOURS 0
+#define EXCHANGE_FIRST 1
+
+
+/*
+ * Global indexes of the two slots proposed for exchange at iteration iter, following schedule. A single slot is
+ * paired with itself.
+ * */
+inline void exchangePair(int iter, int totalS, int schedule, int &glbc1, int &glbc2)
+{
+    if (totalS==1)
+    {
+        glbc1=0;
+        glbc2=0;
+    } else if (schedule==EXCHANGE_FIRST) {
+        glbc1=0;
+        glbc2=1+iter%(totalS-1);
+    } else {
+        glbc1=iter%(totalS-1);
+        glbc2=glbc1+1;
+    }
+}
+
+/*
+ * Group running slot glbc when totalS slots are dealt to groups: totalS/groups slots each, the last group taking the
+ * remainder
+ * */
+inline int slotOwner(int glbc, int totalS, int groups)
+{
+    int pergroup=totalS/groups;
+    return (pergroup==0) ? groups-1 : std::min(glbc/pergroup,groups-1);
+}
+
+
+/*
+*
+* This function runs totalS number of parallel chains each on a temperature level defined in temps.
+* Each group of MPI processes is responsible for 1 or more chains in the pool; a group is a single process unless the
+* model splits every chain over several.
+* Each chain is run iterNum number of iterations where each iteration consists of T number of steps
+* After every iteration two slots picked by the schedule of the model propose to exchange their states. The energies
+* of the chains are cached, so an exchange costs no evaluation of the target, and states only travel between processes
+* once the exchange is accepted.
+*
+* The chain, its target and its kernel come from the model, which provides the types State (one chain, or the part of
+* it held by this process) and Table (what the kernel precomputes at one temperature), the fields
+*   group: communicator of the processes sharing every chain of this one (MPI_COMM_SELF if each process holds its
+*          chains whole); the groups are consecutive blocks of ranks of MPI_COMM_WORLD
+*   schedule: EXCHANGE_NEIGHBOURS or EXCHANGE_FIRST
+* and the functions, called on every process of the group
+*   create(x,temp): allocate x and draw its starting state for a chain at temperature temp
+*   release(x): free x
+*   buildTable(lut,temp): fill the table of temperature temp
+*   sweepChains(xs,luts,T,energies): take every chain T steps forward, adding the changes of energy to energies
+*   energy(x): energy of the whole chain; the target density at temperature temp is exp(logTarget(energy(x),temp))
+*   logTarget(energy,temp)
+*   trade(x,other,comm): swap x with the state of the same slot on rank other of comm
+*   begin(id,first,S,temps): before the first iteration, the group being number id and running slots first..first+S-1
+*   observe(iter,slot,replica,exchanged,energy,x): after every iteration, for every local slot; replica is the replica
+*          now at the slot (replicas are numbered by the slot they start at) and exchanged is 0 if no exchange of the
+*          slot was proposed, 1 if one was rejected and 2 if one was accepted
+*   end(seconds): after the last iteration, given the wall time of the iterations
+*
+* Function Arguments:
+* model: the model and kernel to run
+* iterNum: number of iterations
+* totalS: total number of parallel chains (each group may run more than one chain)
+* T: number of steps each iteration
+* temps: temperatures of the chains
+* rank: rank of current MPI process
+* size: number of concurrent MPI processes (a multiple of the size of model.group)
+*
+* */
+template<class Model>
+void temperedChains(Model &model, int iterNum, int totalS, int T, double *temps, int rank, int size)
+{
+    typedef typename Model::State State;
+    typedef typename Model::Table Table;
+
+    int groupsize;
+    int grouprank;
+    MPI_Comm_size(model.group, &groupsize);
+    MPI_Comm_rank(model.group, &grouprank);
+    int groups=size/groupsize;
+    int group=rank/groupsize;
+
+    // Each group is assigned S chains to run, the last one taking the remainder
+    int S=totalS/groups;
+    if (group==groups-1)
+    {
+        S=totalS/groups+totalS%groups;
+    }
+
+    // Global index of the first chain of this group
+    int first=group*(totalS/groups);
+
+    // Each MPI process has a different seed
+    srand(unsigned(time(0))+rank);
+
+    // Each chain creates a new starting state
+    std::vector<State> xs(S);
+    for (int chains=0; chains<S; ++chains)
+    {
+        model.create(xs[chains], temps[chains+first]);
+    }
+
+    // Tables of the chains, built once the temperatures are assigned. Exchanges move states between temperature
+    // slots, so the table of a slot never changes.
+    std::vector<Table> luts(S);
+    for (int chains=0; chains<S; ++chains)
+    {
+        model.buildTable(luts[chains], temps[chains+first]);
+    }
+
+    // Replica held by each slot; replicas are numbered by the slot they start at and move with the exchanges
+    std::vector<int> replicas(S);
+    std::vector<int> exchanged(S);
+    for (int chains=0; chains<S; ++chains)
+    {
+        replicas[chains]=chains+first;
+    }
+
+    // Energy of every chain, kept up to date from the changes reported by the kernel and moved along with the states
+    std::vector<double> energies(S);
+    for (int chains=0; chains<S; ++chains)
+    {
+        energies[chains]=model.energy(xs[chains]);
+    }
+
+    model.begin(group, first, S, temps);
+
+    /* Define variables used in the loop */
+    int exchangetimes=0; // total number of exchange that occur
+    double logaccpt; // log of the acceptance ratio
+    int glbc1; // global idx of chain 1 to exchange
+    int glbc2; // global idx of chain 2 to exchange
+    int group1; // group that runs chain 1
+    int group2; // group that runs chain 2
+    int accptstatus; // whether the exchange is accepted
+
+    double start=MPI_Wtime();
+    for (int iter=0; iter<iterNum; ++iter){
+
+        model.sweepChains(xs, luts, T, energies);
+        std::fill(exchanged.begin(), exchanged.end(), 0);
+
+        // Global index of the two chain to exchange positions, and which groups they belong to
+        exchangePair(iter, totalS, model.schedule, glbc1, glbc2);
+        group1=slotOwner(glbc1, totalS, groups);
+        group2=slotOwner(glbc2, totalS, groups);
+
+        // Both indexes to exchange belong to current group (a single chain has nobody to exchange with). The root of
+        // the group decides and tells the others. A group involved in no exchange goes straight to observing its
+        // slots.
+        if ((group1==group)&&(group2==group)&&(glbc1!=glbc2)){
+
+            // Convert global indexes to local indexes
+            int c1=glbc1-first;
+            int c2=glbc2-first;
+
+            // Compute acceptance ratio from the cached energies, and determine if accept by toss a random coin
+            accptstatus=0;
+            if (grouprank==0)
+            {
+                logaccpt=model.logTarget(energies[c1],temps[glbc2])+model.logTarget(energies[c2],temps[glbc1])
+                         -model.logTarget(energies[c1],temps[glbc1])-model.logTarget(energies[c2],temps[glbc2]);
+                accptstatus=(unifrnd(0,1)<exp(logaccpt));
+            }
+            MPI_Bcast(&accptstatus, 1, MPI_INT, 0, model.group);
+
+            if (accptstatus==1){
+                // We indeed accept the proposal
+                std::swap(xs[c1],xs[c2]);
+                std::swap(energies[c1],energies[c2]);
+                std::swap(replicas[c1],replicas[c2]);
+                exchangetimes+=1;
+            }
+            exchanged[c1]=1+accptstatus;
+            exchanged[c2]=1+accptstatus;
+        }
+
+            // Indexes to exchange occur on two different groups
+        else if ((group1!=group2)&&((group1==group)||(group2==group))) {
+
+            int c=(group==group1) ? glbc1-first : glbc2-first;
+            int other=(group==group1) ? group2 : group1;
+
+            // The roots of the two groups trade energies and replicas, then the root of group1 decides; the states
+            // only travel if the exchange is accepted, each process trading its part with the process at the same
+            // position in the other group
+            double mine[2]={energies[c],double(replicas[c])};
+            double theirs[2]={0,0};
+            accptstatus=0;
+            if (grouprank==0)
+            {
+                MPI_Sendrecv(mine,2,MPI_DOUBLE,other*groupsize,0,theirs,2,MPI_DOUBLE,other*groupsize,0,
+                             MPI_COMM_WORLD,MPI_STATUS_IGNORE);
+                if (group==group1)
+                {
+                    logaccpt=model.logTarget(energies[c],temps[glbc2])+model.logTarget(theirs[0],temps[glbc1])
+                             -model.logTarget(energies[c],temps[glbc1])-model.logTarget(theirs[0],temps[glbc2]);
+                    accptstatus=(unifrnd(0,1)<exp(logaccpt));
+                    MPI_Send(&accptstatus,1,MPI_INT,other*groupsize,0,MPI_COMM_WORLD);
+                } else {
+                    MPI_Recv(&accptstatus,1,MPI_INT,other*groupsize,0,MPI_COMM_WORLD,MPI_STATUS_IGNORE);
+                }
+            }
+            MPI_Bcast(&accptstatus, 1, MPI_INT, 0, model.group);
+
+            if (accptstatus==1)
+            {
+                MPI_Bcast(theirs, 2, MPI_DOUBLE, 0, model.group);
+                model.trade(xs[c], other*groupsize+grouprank, MPI_COMM_WORLD);
+                energies[c]=theirs[0];
+                replicas[c]=int(theirs[1]);
+
+                exchangetimes+=1;
+            }
+            exchanged[c]=1+accptstatus;
+        }
+
+        for (int chains=0; chains<S; ++chains)
+        {
+            model.observe(iter, chains, replicas[chains], exchanged[chains], energies[chains], xs[chains]);
+        }
+    }
+    double seconds=MPI_Wtime()-start;
+
+    model.end(seconds);
+    for (int chains=0; chains<S; ++chains)
+    {
+        model.release(xs[chains]);
+    }
+}
+
+#endif
@@ -11,6 +11,7 @@
 #include "decipher.h"
 #include "ArrayUtilities.h"
 #include "Randomize.h"
+#include "TemperedChains.h"
 using namespace std;
 
 
@@ -20,7 +21,8 @@ using namespace std;
  * This function runs totalS number of parallel chains each on a temperature level defined in temps.
  * Each MPI process is responsible for 1 or more chains in the pool.
  * Each chain is run iterNum number of iterations where each iteration consists of T number of steps
- * The chains communicates via MPI send and receive. temperedChains outputs result in the result array.
+ * The chains are run by temperedChains on a CipherModel, the first chain proposing to exchange with every other chain
+ * in turn. temperedChains outputs in the result array the most likely key any chain has held, on every process.
  *
  * Function Arguments:
  * iterNum: number of iterations
@@ -32,183 +34,194 @@ using namespace std;
  * result: the pointer to array we output result
  * rank: rank of current MPI process
  * size: number of concurrent MPI processes
+ * init: starting states, 0-uniformly random permutations, 1-frequency matched keys perturbed by temperature
  *
  * */
-void temperedChains(int iterNum, int totalS, int Nd, int T, int **R, int **C, double *temps, int * result, int rank, int size)
+template<int N, class Count>
+void temperedChains(int iterNum, int totalS, int Nd, int T, Matrix<Count> &R, SparseBigram<Count> &C, double *temps, KeySymbol * result, int rank, int size, int init)
 {
-    double maxlogtarget=0.0;
-
-    // Each MPI process is assigned S chains to run
-    int S=totalS/size;
-
-    if (rank==size-1)
+    CipherModel<N,Count> model;
+    model.group=MPI_COMM_SELF;
+    model.schedule=EXCHANGE_FIRST;
+    model.Nd=Nd;
+    model.R=&R;
+    model.C=&C;
+    model.init=init;
+    model.xfreq.resize(Nd);
+    freqpermutation(R,C,Nd,model.xfreq.data());
+    model.best=-HUGE_VAL;
+
+    model.maxtemp=temps[0];
+    for (int i=1; i<totalS; ++i)
     {
-        S=totalS/size+totalS%size;
+        model.maxtemp=std::max(model.maxtemp,temps[i]);
     }
 
-    // Each MPI process has a different seed
-    srand(unsigned(time(0))+rank);
-
-    // Each chain creates a new starting state from uniform sampling
-    int **xs;
-    create2Dmemory(xs, S, Nd);
+    temperedChains(model, iterNum, totalS, T, temps, rank, size);
 
-    int x0[Nd];
-    for (int chains=0; chains<S; ++chains)
+    // The process holding the most likely key broadcasts it to all MPI processes
+    struct
     {
-        for (int i=0; i<Nd; ++i)
-        {
-            x0[i]=i;
-        }
-        rndpermutation(x0,Nd,x0);
-        assignRow(xs, x0, Nd, chains);
+        double value;
+        int rank;
+    } mine, top;
+    mine.value=model.best;
+    mine.rank=rank;
+    MPI_Allreduce(&mine, &top, 1, MPI_DOUBLE_INT, MPI_MAXLOC, MPI_COMM_WORLD);
+    if (rank==top.rank)
+    {
+        deepcopy1Darray(model.bestx.data(), result, Nd);
     }
+    MPI_Bcast(result, Nd, KEY_MPI_TYPE, top.rank, MPI_COMM_WORLD);
+}
 
-
-    /* Define variables used in the loop */
-    int exchangetimes=0; // total number of exchange that occur
-    double originallog; // store value of log target in prev step
-    double proplog; // store value of log target of the proposal
-    int glbc1; // global idx of chain 1 to exchange
-    int glbc2; // global idx of chain 2 to exchange
-    int rank1; // processor that runs chain 1
-    int rank2; // processor that runs chain 2
-    int c1; // local idx of chain 1 to exchange
-    int c2; // local idx of chain 2 to exchange
-    double coin; // store value of coin toss
-    double accpt; // store value of acceptance ratio
-
-    for (int iter=0; iter<iterNum; ++iter){
-
-        for (int chains=0; chains<S; ++chains)
-        {
-            oneChain(xs[chains], T, Nd, xs[chains], R, C, temps[chains+rank*S]);
-        }
-
-        // Global index of the two chain to exchange positions
-        glbc1=0;
-        glbc2=((iter % totalS)==0) ? (1):(iter % totalS);
-        if (totalS==1)
+/*
+ * Starting key of a chain at temperature temp: a uniformly random permutation, or the frequency matched key perturbed
+ * by random swaps, the hotter the chain the fewer
+ * */
+template<int N, class Count>
+void CipherModel<N,Count>::create(std::vector<KeySymbol> &x, double temp)
+{
+    // The key is drawn with the int helpers of Randomize.h and stored narrow
+    int key[keyCapacity<N>()];
+    if (init==1)
+    {
+        std::copy(xfreq.begin(),xfreq.end(),key);
+        int nswaps=int(0.25*Nd*(1-temp/maxtemp)+0.5);
+        int xswapped[keyCapacity<N>()];
+        for (int k=0; k<nswaps; ++k)
         {
-            glbc2=0;
+            rndswap(key,Nd,xswapped);
+            deepcopy1Darray(xswapped,key,Nd);
         }
-
-        // Which processors these two indexes belong to
-        rank1=glbc1/S;
-        rank2=glbc2/S;
-
-        // Current process is not involved in exchange
-        if ((rank1!=rank)&&(rank2!=rank))
+    } else {
+        for (int i=0; i<Nd; ++i)
         {
-            continue;
-        }
-
-        // Both indexes to exchange belong to current process
-        else if (rank1==rank2){
-
-            // Convert global indexes to local indexes
-            c1=glbc1%S;
-            c2=glbc2%S;
-
-            // Compute acceptance ratio
-            originallog=logtarget(xs[c1],Nd,R,C,temps[c1])+logtarget(xs[c2],Nd,R,C,temps[c2]);
-            proplog=logtarget(xs[c1],Nd,R,C,temps[c2])+logtarget(xs[c2],Nd,R,C,temps[c1]);
-
-            accpt=exp(proplog-originallog);
-
-            // Determine if accept by toss a random coin
-            coin=unifrnd(0,1);
-            if (coin<accpt){
-                // We indeed accept the proposal
-                int *imp;
-                imp=xs[c1];
-                xs[c1]=xs[c2];
-                xs[c2]=imp;
-                exchangetimes+=1;
-            }
+            key[i]=i;
         }
+        rndpermutation(key,Nd,key);
+    }
+    x.assign(key,key+Nd);
+}
 
-        // Indexes to exchange occur on two different processes
-        else {
-
-            if (rank == rank1){
-
-                int c1=glbc1%S;
-                double logtgtc1c1=logtarget(xs[c1],Nd,R,C,temps[glbc1]);
-                double logtgtc1c2=logtarget(xs[c1],Nd,R,C,temps[glbc2]);
-
-                int xsc2[Nd];
-                MPI_Recv(xsc2,Nd,MPI_INT,rank2,0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                double logtgtc2c2=logtarget(xsc2,Nd,R,C,temps[glbc2]);
-                double logtgtc2c1=logtarget(xsc2,Nd,R,C,temps[glbc1]);
-
-
-                originallog=logtgtc1c1+logtgtc2c2;
-                proplog=logtgtc1c2+logtgtc2c1;
-
-                accpt=exp(proplog-originallog);
-
+template<int N, class Count>
+void CipherModel<N,Count>::release(std::vector<KeySymbol> &x)
+{
+    x.clear();
+}
 
-                coin=unifrnd(0,1);
-                if (coin<accpt){
-                    // We indeed accept the proposal, notify the other chain
-                    int accptstatus=1;
+// The chain only needs its temperature
+template<int N, class Count>
+void CipherModel<N,Count>::buildTable(double &lut, double temp)
+{
+    lut=temp;
+}
 
-                    MPI_Send(&accptstatus,1,MPI_INT,rank2,0,MPI_COMM_WORLD);
+/*
+ * Run every chain T steps, adding the change of its log target reported by oneChain to its energy
+ * */
+template<int N, class Count>
+void CipherModel<N,Count>::sweepChains(std::vector<std::vector<KeySymbol> > &xs, std::vector<double> &luts, int T,
+                                     std::vector<double> &energies)
+{
+    for (typename std::vector<std::vector<KeySymbol> >::size_type chains=0; chains<xs.size(); ++chains)
+    {
+        energies[chains]+=oneChain<N>(xs[chains].data(), T, Nd, xs[chains].data(), *R, *C, luts[chains]);
+    }
+}
 
-                    MPI_Send(xs[c1],Nd,MPI_INT,rank2,0,MPI_COMM_WORLD);
+template<int N, class Count>
+double CipherModel<N,Count>::energy(std::vector<KeySymbol> &x)
+{
+    return logtarget<N>(x.data(), Nd, *R, *C, 1);
+}
 
-                    deepcopy1Darray(xsc2,xs[c1], Nd);
+template<int N, class Count>
+double CipherModel<N,Count>::logTarget(double energy, double temp)
+{
+    return temp*energy;
+}
 
-                    exchangetimes+=1;
+template<int N, class Count>
+void CipherModel<N,Count>::trade(std::vector<KeySymbol> &x, int other, MPI_Comm comm)
+{
+    MPI_Sendrecv_replace(x.data(), Nd, KEY_MPI_TYPE, other, 0, other, 0, comm, MPI_STATUS_IGNORE);
+}
 
-                } else {
+template<int N, class Count>
+void CipherModel<N,Count>::begin(int, int, int, const double *)
+{
+}
 
-                    int accptstatus=0;
-                    MPI_Send(&accptstatus,1,MPI_INT,rank2,0,MPI_COMM_WORLD);
-                }
+/*
+ * Keep track of the most likely state so far
+ * */
+template<int N, class Count>
+void CipherModel<N,Count>::observe(int, int, int, int, double energy, std::vector<KeySymbol> &x)
+{
+    if (energy>best)
+    {
+        best=energy;
+        bestx=x;
+    }
+}
 
-            } else {
-                int c2=glbc2%S;
-                int accptstatus;
+template<int N, class Count>
+void CipherModel<N,Count>::end(double)
+{
+}
 
-                MPI_Send(xs[c2],Nd,MPI_INT,rank1,0,MPI_COMM_WORLD);
-                MPI_Recv(&accptstatus,1,MPI_INT,rank1,0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 
-                if (accptstatus==1)
-                {
-                    int xsc1[Nd];
-                    MPI_Recv(xsc1,Nd,MPI_INT,rank1,0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                    deepcopy1Darray(xsc1,xs[c2], Nd);
-                    exchangetimes+=1;
-                }
-            }
+/*
+ * Build a starting key by frequency analysis: the k-th most frequent character of the reference text is matched to the
+ * k-th most frequent character of the coded text. Unigram counts are the row sums of the pair counts.
+ *
+ * Function Arguments:
+ * R: word pair counts from reference
+ * C: word pair counts from coded text
+ * Nd: dimension of state space
+ * x0: output, the frequency matched key
+ *
+ * */
+template<class Count>
+void freqpermutation(Matrix<Count> &R, SparseBigram<Count> &C, int Nd, KeySymbol *x0)
+{
+    double reffreq[Nd];
+    double codefreq[Nd];
+    for (int i=0; i<Nd; ++i)
+    {
+        reffreq[i]=0;
+        codefreq[i]=0;
+        for (int j=0; j<Nd; ++j)
+        {
+            reffreq[i]+=R[i][j];
         }
-
-        // Keep track of the most likely state so far
-        if (rank==0)
+        for (int k=C.rowptr[i]; k<C.rowptr[i+1]; ++k)
         {
-            double logtargetnow=logtarget(xs[0],Nd,R,C,1);
-            if (logtargetnow>maxlogtarget)
-            {
-                maxlogtarget=logtargetnow;
-                deepcopy1Darray(xs[0],result,Nd);
-
-            }
+            codefreq[i]+=C.cnt[k];
         }
-
     }
 
-    // At this point, broadcast result from rank 0  process to all MPI processes
-    MPI_Bcast(result, Nd, MPI_INT, 0, MPI_COMM_WORLD);
+    vector<int> refrank(Nd);
+    vector<int> coderank(Nd);
+    iota(refrank.begin(),refrank.end(),0);
+    iota(coderank.begin(),coderank.end(),0);
+    stable_sort(refrank.begin(),refrank.end(),[&](int i,int j){return reffreq[i]>reffreq[j];});
+    stable_sort(coderank.begin(),coderank.end(),[&](int i,int j){return codefreq[i]>codefreq[j];});
 
-    free2Dmemory(xs, S, Nd);
+    for (int k=0; k<Nd; ++k)
+    {
+        x0[refrank[k]]=coderank[k];
+    }
 }
 
 
 /*
  * This function runs a single Markov chain started at x0 for T steps at temperature temp and
- * output the last step at xT.
+ * output the last step at xT. Each step proposes to swap two entries of the key and is accepted
+ * on the incremental change of the log target, keeping the inverse key alongside the state.
+ * N>0 fixes the alphabet size at compile time (and must then equal Nd), so the key buffers live
+ * on the stack at a fixed size and the key loops and the rows of R have constant length.
  *
  * Function arguments:
  * x0: the starting state
@@ -218,56 +231,52 @@ void temperedChains(int iterNum, int totalS, int Nd, int T, int **R, int **C, do
  * R: word pair counts from reference
  * C: word pair counts from  coded file
  * temp: temperature to use
+ * return: change of the (untempered) log target from x0 to xT, the sum of the accepted swap deltas
  *
  * */
-void oneChain(int *x0, int T, int Nd, int *xT, int **R, int **C, double temp) {
+template<int N, class Count>
+double oneChain(KeySymbol *x0, int T, int Nd, KeySymbol *xT, Matrix<Count> &R, SparseBigram<Count> &C, double temp) {
 
-    // Store all steps of the chain
-    int **samples;
-    create2Dmemory(samples, T, Nd);
+    // A fixed alphabet size turns Nd into a constant
+    Nd=keySize<N>(Nd);
 
-    // Initialize the Markov chain
-    assignRow(samples,x0,Nd,0);
+    // Current state of the chain and its inverse
+    alignas(ARRAY_ALIGNMENT) KeySymbol x[keyCapacity<N>()];
+    alignas(ARRAY_ALIGNMENT) KeySymbol xinv[keyCapacity<N>()];
+    deepcopy1Darray(x0,x,Nd);
+    cipherkey2decipherkey<N>(x,xinv,Nd);
+    double delta=0;
 
     // Run the Markov chain
     for(int t=1; t<T; t=t+1)
     {
-
-        if ( t % 1000 == 0 )
+        // Propose to swap entries a and b
+        int a=unifrndint(0,Nd-1);
+        int b=unifrndint(0,Nd-2);
+        if (b>=a)
         {
-            //printf("%d\n",t);
+            b+=1;
         }
 
-        // Previous state
-        int *xtm1=samples[t-1];
-
-        // Propose the next state
-        int xstar[Nd];
-
-        rndswap(xtm1,Nd,xstar);
-
         // Determine if accept by toss a random coin
         double coin=unifrnd(0,1);
 
         // Compute acceptance ratio
-        double accpt=exp(logtarget(xstar,Nd,R,C,temp)-logtarget(xtm1,Nd,R,C, temp));
+        double swapdelta=logtargetswapdelta<N>(x,xinv,Nd,R,C,a,b);
+        double accpt=exp(temp*swapdelta);
 
         if (coin<accpt)
         {
             // We indeed accept the proposal
-            assignRow(samples,xstar,Nd,t);
-        } else {
-            assignRow(samples,xtm1,Nd,t);
+            std::swap(xinv[x[a]],xinv[x[b]]);
+            std::swap(x[a],x[b]);
+            delta+=swapdelta;
         }
 
     }
 
-    for (int i=0; i<Nd; ++i)
-    {
-        xT[i]=samples[T-1][i];
-    }
-
-    free2Dmemory(samples,T,Nd);
+    deepcopy1Darray(x,xT,Nd);
+    return delta;
 }
 
 
@@ -285,42 +294,112 @@ void oneChain(int *x0, int T, int Nd, int *xT, int **R, int **C, double temp) {
  * return: target function value at the input state
  *
  * */
-double logtarget(int *x, int Nd, int **R, int **C, double temp)
+template<int N, class Count>
+double logtarget(KeySymbol *x, int Nd, Matrix<Count> &R, SparseBigram<Count> &C, double temp)
 {
+    if (C.quantized)
+    {
+        return logtargetquantized<N>(x,Nd,C,temp);
+    }
+    Nd=keySize<N>(Nd);
+
+    // Deciphered symbol of each coded symbol
+    alignas(ARRAY_ALIGNMENT) KeySymbol xinv[keyCapacity<N>()];
+    cipherkey2decipherkey<N>(x,xinv,Nd);
 
     double sum=0;
     #pragma omp parallel
     {
         #pragma omp for reduction(+:sum)
-        for (int i=0; i<Nd; ++i)
+        for (int ci=0; ci<Nd; ++ci)
         {
-            for (int j=0; j<Nd; ++j)
+            for (int k=C.rowptr[ci]; k<C.rowptr[ci+1]; ++k)
             {
-                int ci=x[i];
-                int cj=x[j];
-                sum+=log(double(R[i][j]))*double(C[ci][cj]);
+                sum+=log(double(R.data[xinv[ci]*Nd+xinv[C.col[k]]]))*double(C.cnt[k]);
             }
         }
 
     }
 
-    //std::string decipheredstring=buildDecipheredstring(g_cipheredstring, x);
-
     return temp*sum;
 }
 
 
+/*
+ * The function returns logtarget(y,...,1)-logtarget(x,...,1) where y is x with entries a and b swapped. Only the
+ * pairs of the coded text involving the two coded symbols x[a] and x[b] change, so this visits two rows and two
+ * columns of C.
+ *
+ * Function Arguments:
+ * x: the current state of the chain
+ * xinv: the inverse of x
+ * Nd: dimension of state space
+ * R: word pair counts from reference
+ * C: word pair counts from coded text
+ * a, b: the two entries of x to swap
+ * return: change of the (untempered) log target
+ *
+ * */
+template<int N, class Count>
+double logtargetswapdelta(KeySymbol *x, KeySymbol *xinv, int Nd, Matrix<Count> &R, SparseBigram<Count> &C, int a, int b)
+{
+    if (C.quantized)
+    {
+        return logtargetswapdeltaquantized<N>(x,xinv,Nd,C,a,b);
+    }
+    Nd=keySize<N>(Nd);
+
+    int u=x[a];
+    int v=x[b];
+
+    // Inverse of the proposed state
+    auto yinv=[&](int c){return (c==u) ? b : ((c==v) ? a : xinv[c]);};
+
+    // Log count of the pair (i,j) of R, whose rows are Nd long
+    auto logR=[&](int i, int j){return log(double(R.data[i*Nd+j]));};
+
+    double delta=0;
+    int swapped[2]={u,v};
+    for (int s=0; s<2; ++s)
+    {
+        // Rows u and v, including their columns u and v
+        int ci=swapped[s];
+        for (int k=C.rowptr[ci]; k<C.rowptr[ci+1]; ++k)
+        {
+            int cj=C.col[k];
+            delta+=(logR(yinv(ci),yinv(cj))-logR(xinv[ci],xinv[cj]))*double(C.cnt[k]);
+        }
+
+        // Columns u and v of the remaining rows
+        int cj=swapped[s];
+        for (int k=C.colptr[cj]; k<C.colptr[cj+1]; ++k)
+        {
+            int ci=C.row[k];
+            if ((ci==u)||(ci==v))
+            {
+                continue;
+            }
+            delta+=(logR(xinv[ci],yinv(cj))-logR(xinv[ci],xinv[cj]))*double(C.colcnt[k]);
+        }
+    }
+
+    return delta;
+}
+
+
+
 
 /*
  * Rotate out the worst U chains and re-start them at the best U chains
  * */
-void rotateout(int **xs, int S, int Nd, int U, int **R, int **C, double temp)
+template<class Count>
+void rotateout(Matrix<KeySymbol> &xs, int S, int Nd, int U, Matrix<Count> &R, SparseBigram<Count> &C, double temp)
 {
     int targetvals[S];
 
     for (int chains=0; chains<S; ++chains)
     {
-        targetvals[chains]=logtarget(xs[chains], Nd, R, C, temp);
+        targetvals[chains]=logtarget<0>(xs[chains], Nd, R, C, temp);
 
     }
 
@@ -332,6 +411,25 @@ void rotateout(int **xs, int S, int Nd, int U, int **R, int **C, double temp)
 
     for (int u=0; u<U; ++u)
     {
-        assignRow(xs,xs[V[S-u-1]],Nd,V[u]);
+        copyRow(xs,V[S-u-1],V[u]);
     }
 }
+
+
+// The chains are compiled for every alphabet size and pair count type of FOR_EACH_KEY_KERNEL; rotateout, which is not
+// on the hot path, only for run time sizes
+#define INSTANTIATE_CHAINS(N, Count) \
+    template void temperedChains<N,Count>(int iterNum, int totalS, int Nd, int T, Matrix<Count> &R, \
+                                          SparseBigram<Count> &C, double *temps, KeySymbol * result, int rank, \
+                                          int size, int init); \
+    template double logtarget<N,Count>(KeySymbol *x, int Nd, Matrix<Count> &R, SparseBigram<Count> &C, double temp); \
+    template double oneChain<N,Count>(KeySymbol *x0, int T, int Nd, KeySymbol *xT, Matrix<Count> &R, \
+                                      SparseBigram<Count> &C, double temp); \
+    template double logtargetswapdelta<N,Count>(KeySymbol *x, KeySymbol *xinv, int Nd, Matrix<Count> &R, \
+                                                SparseBigram<Count> &C, int a, int b);
+FOR_EACH_KEY_KERNEL(INSTANTIATE_CHAINS)
+
+template void rotateout<uint16_t>(Matrix<KeySymbol> &xs, int S, int Nd, int U, Matrix<uint16_t> &R,
+                                  SparseBigram<uint16_t> &C, double temp);
+template void rotateout<uint32_t>(Matrix<KeySymbol> &xs, int S, int Nd, int U, Matrix<uint32_t> &R,
+                                  SparseBigram<uint32_t> &C, double temp);
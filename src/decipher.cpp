@@ -16,20 +16,17 @@
 
 
 
-int main(int argc, char** argv){
-
+/*
+ * Decipher the coded text cipheredstring (read from cipheredtxt) against the reference pair counts counts, with the
+ * pair counts stored as Count, and report the key and the accuracy. N>0 is the alphabet size Nd fixed at compile time.
+ * The settings are read from the command line as described in main.
+ * */
+template<int N, class Count>
+void decipherCounts(Matrix<uint32_t> &counts, std::string cipheredtxt, std::string g_cipheredstring, int Nd, int argc,
+                    char** argv, int rank, int size)
+{
     int Sp = (argc > 1) ? atoi(argv[1]) : 1;
 
-    int rank, size;
-
-    // Initialize MPI and get rank and size
-    MPI_Init(NULL, NULL);
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
-
-    // Dimension of the key
-    int Nd=95;
-
     // Number of steps each iteration
     int T=500;
 
@@ -49,67 +46,57 @@ int main(int argc, char** argv){
     }
     temps[0]=10000;
 
-    // Generate the ciphered file
-    if (rank==0)
-    {
-        // Randomly generate a cipher key
-        int cipherkey[Nd];
-        for (int i=0; i<Nd-1; ++i)
-        {
-            cipherkey[i]=Nd-2-i;
-        }
-        cipherkey[Nd-1]=Nd-1;
-        //rndpermutation(cipherkey,Nd,cipherkey);
+    // Number of proposals, weight of the dictionary word-score, cooling schedule and share of dictionary pattern
+    // proposals of the annealing fine stage
+    int annealsteps=20000;
+    double annealweight=(argc > 2) ? atof(argv[2]) : 5;
+    double annealtemp0=(argc > 3) ? atof(argv[3]) : 20;
+    double annealtemp1=(argc > 4) ? atof(argv[4]) : 0.1;
+    double patternprob=(argc > 5) ? atof(argv[5]) : 0.3;
 
-        // Use the cipher key to cipher the original file at this path: file2cipher
-        std::string file2cipher="../data/code.txt";
-        std::string cipheredfile="../data/ciphered.txt";
-        buildCiphered(file2cipher, cipheredfile, cipherkey);
-    }
+    // Starting keys of the chains: 0-random permutations, 1-unigram frequency matching
+    int init=(argc > 6) ? atoi(argv[6]) : 1;
 
-    // Count frequency of character pairs in reference text
-    int **R;
-    create2Dmemory(R, Nd, Nd);
-    std::string referencetxt="../data/ak.txt";
-    buildTransitionMat(R, Nd,referencetxt);
+    // Scoring backend: 0-double, 1-int16 fixed point
+    int quantized=(argc > 7) ? atoi(argv[7]) : 0;
+
+    // Reference pair counts in the storage type of the scorer
+    Matrix<Count> R(Nd, Nd);
+    convertMatrix(counts, R);
 
     // Count frequency of character pairs in the ciphered text (located at path: cipheredtxt)
-    int **C;
-    create2Dmemory(C, Nd, Nd);
-    std::string cipheredtxt="../data/ciphered.txt";
-    buildTransitionMat(C, Nd,cipheredtxt);
+    SparseBigram<Count> C;
+    buildSparseTransitionMat(C, Nd,cipheredtxt);
+    if (quantized==1)
+    {
+        quantizeScorer(C, R, Nd);
+    }
 
     // Decipher the text using api temperedChains and store output in [result] variable below
-    int result[Nd];
-    temperedChains(iterNum, totalS, Nd, T, R, C, temps, result, rank, size);
+    KeySymbol result[KEY_SYMBOLS];
+    auto start=std::chrono::steady_clock::now();
+    temperedChains<N>(iterNum, totalS, Nd, T, R, C, temps, result, rank, size, init);
+    std::chrono::duration<double> elapsed=std::chrono::steady_clock::now()-start;
 
     // Print the result
     if (rank==0) print1Darray(result, Nd);
-    if (rank==0) printf("Target:%f\n", logtarget(result, Nd, R, C, 1));
-
-
-    // Use the key found to decipher the ciphered text and store it at this path: decipheredtext
-    std::string decipheredtext = "../data/deciphered.txt";
-    cipherkey2decipherkey(result, result, Nd);
-    buildDeciphered(cipheredtxt, decipheredtext, result);
-
-
-    // Put deciphered file into a string for finer processing
-    std::string g_cipheredstring=readcodefile(cipheredtxt);
-    std::string decipheredstring=buildDecipheredstring(g_cipheredstring, result);
-    if (rank==0) printf("%s\n",decipheredstring.c_str());
+    if (rank==0) printf("Target:%f\n", logtarget<N>(result, Nd, R, C, 1));
+    if (rank==0) printf("Tempered chains time:%f s (%d-bit pair counts)\n", elapsed.count(), int(8*sizeof(Count)));
 
     std::map<std::string, int> g_dict;
     buildWordsFreqMap("../data/google-10000-english-usa.txt", g_dict);
 
-    int CWFS;
-    double percwords;
-    int wordcount;
-    CWFScore(decipheredstring, CWFS, percwords, g_dict,wordcount);
+    // Refine the key by annealing on the bigram log-target mixed with the dictionary word-score
+    KeySymbol resultfine[KEY_SYMBOLS];
+    double objective=annealOptimize<N>(result, Nd, annealsteps, R, C, g_cipheredstring, g_dict, annealweight,
+                                    annealtemp0, annealtemp1, patternprob, resultfine, rank);
+    if (rank==0) printf("Annealed objective:%f\n", objective);
 
-    int resultfine[Nd];
-    fineOptimize(result,Nd,10000,g_cipheredstring,resultfine,g_dict,rank);
-    decipheredstring=buildDecipheredstring(g_cipheredstring, resultfine);
+    // Use the key found to decipher the ciphered text and store it at this path: decipheredtext
+    std::string decipheredtext = "../data/deciphered.txt";
+    cipherkey2decipherkey(resultfine, resultfine, Nd);
+    buildDeciphered(cipheredtxt, decipheredtext, resultfine);
+    std::string decipheredstring=buildDecipheredstring(g_cipheredstring, resultfine);
     MPI_Barrier(MPI_COMM_WORLD);
     if (rank==0)
     {
@@ -127,13 +114,92 @@ int main(int argc, char** argv){
         }
         printf("Accuracy: %f\n", (correct)/(sum));
     }
-    
+}
+
+/*
+ * Run decipherCounts on the kernels compiled for the alphabet size Nd, or on the ones sized at run time when Nd is not
+ * one of them (see FOR_EACH_KEY_KERNEL)
+ * */
+template<class Count>
+void decipherAlphabet(Matrix<uint32_t> &counts, std::string cipheredtxt, std::string g_cipheredstring, int Nd,
+                      int argc, char** argv, int rank, int size)
+{
+    if (Nd==KEY_LETTERS)
+    {
+        decipherCounts<KEY_LETTERS,Count>(counts, cipheredtxt, g_cipheredstring, Nd, argc, argv, rank, size);
+    } else if (Nd==KEY_PRINTABLE) {
+        decipherCounts<KEY_PRINTABLE,Count>(counts, cipheredtxt, g_cipheredstring, Nd, argc, argv, rank, size);
+    } else if (Nd==KEY_BYTES) {
+        decipherCounts<KEY_BYTES,Count>(counts, cipheredtxt, g_cipheredstring, Nd, argc, argv, rank, size);
+    } else {
+        decipherCounts<0,Count>(counts, cipheredtxt, g_cipheredstring, Nd, argc, argv, rank, size);
+    }
+}
 
 
-    free2Dmemory(C, Nd, Nd);
-    free2Dmemory(R, Nd, Nd);
+int main(int argc, char** argv){
+
+    int rank, size;
+
+    // Initialize MPI and get rank and size
+    MPI_Init(NULL, NULL);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // Alphabet of the cipher: 0-printable ASCII, 1-letters only, 2-raw bytes. The dimension of the key is its size.
+    selectAlphabet((argc > 8) ? atoi(argv[8]) : ALPHABET_PRINTABLE);
+    int Nd=currentAlphabet().symbols;
+    if (Nd>KEY_SYMBOLS)
+    {
+        throw "Key has more symbols than KeySymbol can hold";
+    }
+
+    // Generate the ciphered file
+    if (rank==0)
+    {
+        // Randomly generate a cipher key
+        KeySymbol cipherkey[KEY_SYMBOLS];
+        for (int i=0; i<Nd-1; ++i)
+        {
+            cipherkey[i]=Nd-2-i;
+        }
+        cipherkey[Nd-1]=Nd-1;
+        //rndpermutation(cipherkey,Nd,cipherkey);
+
+        // Use the cipher key to cipher the original file at this path: file2cipher
+        std::string file2cipher="../data/code.txt";
+        std::string cipheredfile="../data/ciphered.txt";
+        buildCiphered(file2cipher, cipheredfile, cipherkey);
+    }
+
+    // Count frequency of character pairs in the reference texts: the files and directories given after the alphabet,
+    // or ../data/ak.txt
+    Matrix<uint32_t> R(Nd, Nd);
+    std::vector<std::string> referencetxt;
+    for (int k=9; k<argc; ++k)
+    {
+        referencetxt.push_back(argv[k]);
+    }
+    if (referencetxt.empty())
+    {
+        referencetxt.push_back("../data/ak.txt");
+    }
+    double countstart=MPI_Wtime();
+    buildTransitionMat(R, Nd,referencetxt);
+    if (rank==0) printf("Reference counting time:%f s\n", MPI_Wtime()-countstart);
+
+    // Put ciphered file into a string for finer processing
+    std::string cipheredtxt="../data/ciphered.txt";
+    std::string g_cipheredstring=readcodefile(cipheredtxt);
+
+    // Pair counts are scored in 16 bits when both texts are short enough, halving the table the chains look up
+    if (countsFit<uint16_t>(R, g_cipheredstring.size()))
+    {
+        decipherAlphabet<uint16_t>(R, cipheredtxt, g_cipheredstring, Nd, argc, argv, rank, size);
+    } else {
+        decipherAlphabet<uint32_t>(R, cipheredtxt, g_cipheredstring, Nd, argc, argv, rank, size);
+    }
+
     MPI_Finalize();
     return 0;
 }
-
-
@@ -1,26 +1,276 @@
+#include <cstdint>
+#include <limits>
+#include "ArrayUtilities.h"
+
+/*
+ * Entry of a substitution key: the symbol a symbol maps to. Keys of up to KEY_SYMBOLS symbols fit in a byte, so a key
+ * of the printable alphabet is 95 bytes and travels between processes as KEY_MPI_TYPE.
+ * */
+typedef uint8_t KeySymbol;
+#define KEY_SYMBOLS 256
+#define KEY_MPI_TYPE MPI_UINT8_T
+
+/*
+ * Alphabet sizes the chains, the scorer and the annealing stage are compiled for, see FOR_EACH_KEY_KERNEL. A kernel of
+ * size N>0 has its key loops of fixed trip count and its key buffers of fixed size on the stack; N=0 takes the size
+ * from its Nd argument and serves any other alphabet.
+ * */
+#define KEY_LETTERS 26
+#define KEY_PRINTABLE 95
+#define KEY_BYTES 256
+
+/*
+ * Instantiations of the kernels: M(N,Count) for every alphabet size N and pair count type Count, main dispatching to
+ * one of them once the alphabet and the counts are known
+ * */
+#define FOR_EACH_KEY_KERNEL(M) \
+    M(0,uint16_t) M(0,uint32_t) \
+    M(KEY_LETTERS,uint16_t) M(KEY_LETTERS,uint32_t) \
+    M(KEY_PRINTABLE,uint16_t) M(KEY_PRINTABLE,uint32_t) \
+    M(KEY_BYTES,uint16_t) M(KEY_BYTES,uint32_t)
+
+/*
+ * Number of symbols of a key: the template alphabet size N when it is fixed at compile time, Nd otherwise
+ * */
+template<int N>
+inline int keySize(int Nd)
+{
+    return (N>0) ? N : Nd;
+}
+
+// Length of a key buffer on the stack of a kernel of alphabet size N
+template<int N>
+constexpr int keyCapacity()
+{
+    return (N>0) ? N : KEY_SYMBOLS;
+}
+
+/*
+ * Inverse of the key cipherkey of Nd symbols (in place if decipherkey is cipherkey)
+ * */
+template<int N=0>
+inline void cipherkey2decipherkey(KeySymbol *cipherkey, KeySymbol *decipherkey, int Nd)
+{
+    Nd=keySize<N>(Nd);
+    alignas(ARRAY_ALIGNMENT) KeySymbol container[keyCapacity<N>()];
+    for (int i=0; i<Nd; ++i)
+    {
+        container[cipherkey[i]]=i;
+    }
+    deepcopy1Darray(container,decipherkey,Nd);
+}
+
+/*
+ * Alphabets of the cipher: the 95 printable ASCII characters 32..126, the 26 letters with upper and lower case folded
+ * together, or all 256 byte values
+ * */
+#define ALPHABET_PRINTABLE 0
+#define ALPHABET_LETTERS 1
+#define ALPHABET_BYTES 2
+
+// Symbol of a byte outside the alphabet: the translations leave such a byte as it is and the pair counts skip it
+#define ALPHABET_OUTSIDE (-1)
+
+/*
+ * Dense mapping of an alphabet of symbols symbols: symbol[b] is the symbol of byte b (ALPHABET_OUTSIDE if b is not in
+ * the alphabet) and byte[s] the byte written for symbol s, so translating a character is two table lookups and no
+ * branch
+ * */
+struct Alphabet
+{
+    int symbols;
+    int symbol[256];
+    unsigned char byte[KEY_SYMBOLS];
+};
+
+/*
+ * Tables of alphabet kind, built at compile time (see CypherUtilities.cpp)
+ * */
+constexpr Alphabet buildAlphabet(int kind)
+{
+    Alphabet a{0,{},{}};
+    for (int b=0; b<256; ++b)
+    {
+        int s=ALPHABET_OUTSIDE;
+        if (kind==ALPHABET_BYTES)
+        {
+            s=b;
+        } else if (kind==ALPHABET_LETTERS) {
+            if (b>='a' && b<='z')
+            {
+                s=b-'a';
+            } else if (b>='A' && b<='Z') {
+                s=b-'A';
+            }
+        } else if (b>=32 && b<=126) {
+            s=b-32;
+        }
+        a.symbol[b]=s;
+
+        // A symbol is written as its last byte, which is the lower case one for the letters
+        if (s!=ALPHABET_OUTSIDE)
+        {
+            a.byte[s]=(unsigned char)(b);
+            a.symbols=std::max(a.symbols,s+1);
+        }
+    }
+    return a;
+}
+
+/*
+ * Whether the ciphered symbol c, ALPHABET_OUTSIDE for a character outside the alphabet, deciphers to a letter. Such a
+ * character is left as it is, so it separates words like any other non-letter.
+ * */
+inline bool decipheredLetter(int c, const KeySymbol *decipherkey, const bool *isletter)
+{
+    return (c!=ALPHABET_OUTSIDE)&&isletter[decipherkey[c]];
+}
+
+/*
+ * Whether every pair count of the reference counts R, and every pair count of a coded text of chars characters, fits
+ * in Count
+ * */
+template<class Count>
+bool countsFit(const Matrix<uint32_t> &R, size_t chars)
+{
+    return (maxEntry(R)<=std::numeric_limits<Count>::max())&&(chars<=std::numeric_limits<Count>::max());
+}
+
+/*
+ * Pair counts of the coded text, keeping only the pairs that occur. Row ci lists the pairs (ci, col[k]) with count
+ * cnt[k] for rowptr[ci]<=k<rowptr[ci+1] (compressed sparse rows). The same pairs are listed by column in
+ * colptr/row/colcnt so that a single column can be visited without scanning every row. When quantized is set the
+ * scorer works in fixed point (see QuantizedScore.cpp). Counts are stored as Count, the type of the reference counts
+ * they are scored against (uint16_t when the texts are short enough, see countsFit).
+ * */
+template<class Count>
+struct SparseBigram
+{
+    int Nd;
+    std::vector<int> rowptr;
+    std::vector<int> col;
+    std::vector<Count> cnt;
+    std::vector<int> colptr;
+    std::vector<int> row;
+    std::vector<Count> colcnt;
+
+    // Fixed point scorer filled by quantizeScorer: qlogR[i*Nd+j] is log(R[i][j]) scaled by qscale, and the nonzero
+    // pairs are repeated as (qrow, qcol, qcnt) with int16 counts, row ci at qrowptr[ci]..qrowptr[ci+1]-1, and by
+    // column as (qcolrow, qcolcnt), column cj at qcolptr[cj]..qcolptr[cj+1]-1
+    bool quantized;
+    double qscale;
+    std::vector<int16_t> qlogR;
+    std::vector<int> qrowptr;
+    std::vector<int> qrow;
+    std::vector<int> qcol;
+    std::vector<int16_t> qcnt;
+    std::vector<int> qcolptr;
+    std::vector<int> qcolrow;
+    std::vector<int16_t> qcolcnt;
+};
+
+/*
+ * Substitution keys of Nd symbols scored by the pair counts R of the reference text and C of the coded text, as a
+ * model of temperedChains (see TemperedChains.h). The energy of a key is its untempered log target, and a chain at
+ * temperature temp targets exp(temp*energy). The model keeps the best key any of the chains of this process has held.
+ * N>0 fixes the alphabet size at compile time and must then equal Nd.
+ * */
+template<int N, class Count>
+struct CipherModel
+{
+    typedef std::vector<KeySymbol> State;
+    typedef double Table;
+
+    MPI_Comm group;
+    int schedule;
+    int Nd;
+    Matrix<Count> *R;
+    SparseBigram<Count> *C;
+    int init;
+    double maxtemp;
+    std::vector<KeySymbol> xfreq;
+    double best;
+    std::vector<KeySymbol> bestx;
+
+    void create(std::vector<KeySymbol> &x, double temp);
+    void release(std::vector<KeySymbol> &x);
+    void buildTable(double &lut, double temp);
+    void sweepChains(std::vector<std::vector<KeySymbol> > &xs, std::vector<double> &luts, int T,
+                     std::vector<double> &energies);
+    double energy(std::vector<KeySymbol> &x);
+    double logTarget(double energy, double temp);
+    void trade(std::vector<KeySymbol> &x, int other, MPI_Comm comm);
+    void begin(int id, int first, int S, const double *temps);
+    void observe(int iter, int slot, int replica, int exchanged, double energy, std::vector<KeySymbol> &x);
+    void end(double seconds);
+};
+
 /* MCMC.cpp */
-double logtarget(int *x, int Nd, int **R, int **C, double temp);
-void oneChain(int *x0, int T, int Nd, int *xT, int **R, int **C, double temp);
-void temperedChains(int iterNum, int totalS, int Nd, int T, int **R, int **C, double *temps, int * result, int rank, int size);
-void rotateout(int **xs, int S, int Nd, int U, int **R, int **C, double temp);
+template<int N, class Count>
+double logtarget(KeySymbol *x, int Nd, Matrix<Count> &R, SparseBigram<Count> &C, double temp);
+template<int N, class Count>
+double logtargetswapdelta(KeySymbol *x, KeySymbol *xinv, int Nd, Matrix<Count> &R, SparseBigram<Count> &C, int a, int b);
+template<int N, class Count>
+double oneChain(KeySymbol *x0, int T, int Nd, KeySymbol *xT, Matrix<Count> &R, SparseBigram<Count> &C, double temp);
+template<int N, class Count>
+void temperedChains(int iterNum, int totalS, int Nd, int T, Matrix<Count> &R, SparseBigram<Count> &C, double *temps, KeySymbol * result, int rank, int size, int init);
+template<class Count>
+void freqpermutation(Matrix<Count> &R, SparseBigram<Count> &C, int Nd, KeySymbol *x0);
+template<class Count>
+void rotateout(Matrix<KeySymbol> &xs, int S, int Nd, int U, Matrix<Count> &R, SparseBigram<Count> &C, double temp);
 
 
 
 /* CypherUtilities.cpp */
-void buildTransitionMat(int **R, int numchar, std::string file);
+void selectAlphabet(int kind);
+const Alphabet &currentAlphabet();
+void buildTransitionMat(Matrix<uint32_t> &R, int numchar, const std::vector<std::string> &sources);
+template<class Count>
+void buildSparseTransitionMat(SparseBigram<Count> &C, int numchar, std::string file);
 int char2num(char ch);
 char num2char(int num);
-char cipher(char ch, int *cipherkey);
-char decipher(char ch, int *decipherkey);
-void cipherkey2decipherkey(int *cipherkey, int *decipherkey, int Nd);
-void buildCiphered(std::string inputfile, std::string outputfile, int *cipherkey);
-void buildDeciphered(std::string inputfile, std::string outputfile, int *decipherkey);
-std::string buildDecipheredstring(std::string inputstring,  int *decipherkey);
+char cipher(char ch, KeySymbol *cipherkey);
+char decipher(char ch, KeySymbol *decipherkey);
+void buildCiphered(std::string inputfile, std::string outputfile, KeySymbol *cipherkey);
+void buildDeciphered(std::string inputfile, std::string outputfile, KeySymbol *decipherkey);
+std::string buildDecipheredstring(std::string inputstring,  KeySymbol *decipherkey);
+void keyTranslation(KeySymbol *key, unsigned char *table);
 std::string readcodefile(std::string inputfile);
-
-/* FineSearch.cpp */
+bool isaphbt(char ch);
 void buildWordsFreqMap(std::string dicttext, std::map<std::string, int> &dict);
-void CWFScore(std::string inputstr, int &CWFS, double &percwords, std::map<std::string, int> g_dict, int &wordcount);
-void fineOptimize(int * x, int Nd, int TT, std::string cipheredstring, int * output, std::map<std::string, int> g_dict, int rank);
 
+/* PairCounting.cpp */
+void listSources(std::string path, std::vector<std::string> &files);
+void countBytePairs(const unsigned char *text, size_t n, std::vector<uint64_t> &total);
+void countPairs(Matrix<uint32_t> &counts, int numchar, const std::vector<std::string> &sources);
+
+/* Annealing.cpp */
+int wordscoreSpan(std::vector<int> &code, KeySymbol *decipherkey, bool *isletter, int lo, int hi, std::map<std::string, int> &g_dict);
+int wordscoreSwapDelta(std::vector<int> &code, std::vector<std::vector<int> > &occurrences, KeySymbol *decipherkey,
+                       bool *isletter, int u, int v, std::map<std::string, int> &g_dict);
+template<int N, class Count>
+double annealOptimize(KeySymbol *x, int Nd, int TT, Matrix<Count> &R, SparseBigram<Count> &C, std::string cipheredstring, std::map<std::string, int> &g_dict,
+                      double weight, double temp0, double temp1, double patternprob, KeySymbol *output, int rank);
+
+/* PatternProposal.cpp */
+std::string wordpattern(std::string word);
+std::string symbolpattern(std::vector<int> &word);
+void buildPatternIndex(std::map<std::string, int> &g_dict, std::map<std::string, std::vector<std::string> > &patterns);
+void buildCipherWords(std::vector<int> &code, KeySymbol *decipherkey, bool *isletter,
+                      std::map<std::string, std::vector<std::string> > &patterns,
+                      std::vector<std::vector<int> > &cipherwords, std::vector<double> &cipherwordsprob);
+void patternswaps(KeySymbol *decipherkey, int Nd, std::vector<int> &cipherword, std::string dictword,
+                  std::vector<std::pair<int, int> > &swaps);
+void applyswaps(KeySymbol *decipherkey, int Nd, std::vector<std::pair<int, int> > &swaps);
+double patternProposal(KeySymbol *decipherkey, int Nd, std::vector<std::vector<int> > &cipherwords,
+                       std::vector<double> &cipherwordsprob, std::map<std::string, std::vector<std::string> > &patterns,
+                       double patternprob, std::vector<std::pair<int, int> > &swaps);
 
+/* QuantizedScore.cpp */
+template<class Count>
+void quantizeScorer(SparseBigram<Count> &C, Matrix<Count> &R, int Nd);
+int64_t dotint16(const int16_t *a, const int16_t *b, int n);
+template<int N, class Count>
+double logtargetquantized(KeySymbol *x, int Nd, SparseBigram<Count> &C, double temp);
+template<int N, class Count>
+double logtargetswapdeltaquantized(KeySymbol *x, KeySymbol *xinv, int Nd, SparseBigram<Count> &C, int a, int b);
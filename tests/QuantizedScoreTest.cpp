@@ -0,0 +1,176 @@
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <mpi.h>
+#include "decipher.h"
+#include "ArrayUtilities.h"
+
+
+// Steps of every trajectory, and steps between two checks of the tracked log-targets against a full evaluation
+#define TRAJECTORY_STEPS 20000
+#define TRAJECTORY_CHECK 500
+
+
+/*
+ * Run the swap chain of oneChain from the same fixed-seed key with the double and the int16 fixed point scorer side by
+ * side, feeding both the same proposals and coins from one fixed-seed generator, and check step by step that both
+ * chains accept the same swaps (so the keys stay equal) and that their swap deltas and log-targets agree within the
+ * quantization error. A log count is off by at most 0.5/qscale after quantization, so a score over the pairs of C is
+ * off by at most half the number of pairs over qscale, and a difference of two scores by twice that. Returns the
+ * number of failed checks.
+ *
+ * Function Arguments:
+ * R: word pair counts from reference
+ * C: word pair counts from coded text, scored in double
+ * Cq: the same counts, quantized by quantizeScorer
+ * Nd: dimension of state space
+ * temp: temperature of the chains
+ * seed: seed of the starting key, the proposals and the coins
+ *
+ * */
+template<int N, class Count>
+int compareBackends(Matrix<Count> &R, SparseBigram<Count> &C, SparseBigram<Count> &Cq, int Nd, double temp,
+                    unsigned seed)
+{
+    double pairs=0;
+    for (typename std::vector<Count>::size_type k=0; k<C.cnt.size(); ++k)
+    {
+        pairs+=C.cnt[k];
+    }
+    double tolerance=pairs/Cq.qscale+1e-9;
+
+    std::mt19937 gen(seed);
+    std::vector<KeySymbol> xd(Nd);
+    for (int k=0; k<Nd; ++k)
+    {
+        xd[k]=KeySymbol(k);
+    }
+    std::shuffle(xd.begin(), xd.end(), gen);
+    std::vector<KeySymbol> xq(xd);
+    std::vector<KeySymbol> xinvd(Nd);
+    std::vector<KeySymbol> xinvq(Nd);
+    cipherkey2decipherkey<N>(xd.data(), xinvd.data(), Nd);
+    cipherkey2decipherkey<N>(xq.data(), xinvq.data(), Nd);
+
+    double ed=logtarget<N>(xd.data(), Nd, R, C, 1);
+    double eq=logtarget<N>(xq.data(), Nd, R, Cq, 1);
+    int failures=0;
+    int accepted=0;
+    if (fabs(ed-eq)>tolerance)
+    {
+        std::cout<<"Starting log-targets differ: "<<ed<<" (double) "<<eq<<" (quantized)\n";
+        failures+=1;
+    }
+
+    std::uniform_int_distribution<int> pick(0, Nd-1);
+    std::uniform_int_distribution<int> pickother(0, Nd-2);
+    std::uniform_real_distribution<double> unif(0, 1);
+    for (int t=1; (t<=TRAJECTORY_STEPS)&&(failures==0); ++t)
+    {
+        int a=pick(gen);
+        int b=pickother(gen);
+        if (b>=a)
+        {
+            b+=1;
+        }
+        double coin=unif(gen);
+
+        double deltad=logtargetswapdelta<N>(xd.data(), xinvd.data(), Nd, R, C, a, b);
+        double deltaq=logtargetswapdelta<N>(xq.data(), xinvq.data(), Nd, R, Cq, a, b);
+        if (fabs(deltad-deltaq)>2*tolerance)
+        {
+            std::cout<<"Step "<<t<<": swap deltas differ: "<<deltad<<" (double) "<<deltaq<<" (quantized)\n";
+            failures+=1;
+        }
+
+        bool acceptd=(coin<exp(temp*deltad));
+        bool acceptq=(coin<exp(temp*deltaq));
+        if (acceptd!=acceptq)
+        {
+            std::cout<<"Step "<<t<<": the backends disagree on the swap ("<<a<<","<<b<<")\n";
+            failures+=1;
+        }
+        if (acceptd)
+        {
+            std::swap(xinvd[xd[a]], xinvd[xd[b]]);
+            std::swap(xd[a], xd[b]);
+            ed+=deltad;
+            accepted+=1;
+        }
+        if (acceptq)
+        {
+            std::swap(xinvq[xq[a]], xinvq[xq[b]]);
+            std::swap(xq[a], xq[b]);
+            eq+=deltaq;
+        }
+
+        if (xd!=xq)
+        {
+            std::cout<<"Step "<<t<<": the keys differ\n";
+            failures+=1;
+        }
+        if (fabs(ed-eq)>tolerance+1e-6*(1+fabs(ed)))
+        {
+            std::cout<<"Step "<<t<<": log-targets differ: "<<ed<<" (double) "<<eq<<" (quantized)\n";
+            failures+=1;
+        }
+        if (t%TRAJECTORY_CHECK==0)
+        {
+            double fulld=logtarget<N>(xd.data(), Nd, R, C, 1);
+            double fullq=logtarget<N>(xq.data(), Nd, R, Cq, 1);
+            if ((fabs(fulld-fullq)>tolerance)||(fabs(ed-fulld)>1e-6*(1+fabs(fulld)))||
+                (fabs(eq-fullq)>1e-6*(1+fabs(fullq))))
+            {
+                std::cout<<"Step "<<t<<": tracked log-targets "<<ed<<" "<<eq<<", evaluated "<<fulld<<" "<<fullq<<"\n";
+                failures+=1;
+            }
+        }
+    }
+
+    std::cout<<"N="<<N<<" temp="<<temp<<" seed="<<seed<<": "<<accepted<<" swaps accepted, final log-target "<<ed
+             <<" (double) "<<eq<<" (quantized), "<<failures<<" failures\n";
+    return failures;
+}
+
+
+/*
+ * Acceptance test of the int16 fixed point scorer: chains scored by it must follow the chains scored in double.
+ *
+ * Usage: QuantizedScoreTest reference.txt coded.txt
+ *
+ * */
+int main(int argc, char** argv)
+{
+    MPI_Init(&argc, &argv);
+    if (argc<3)
+    {
+        std::cout<<"Usage: QuantizedScoreTest reference.txt coded.txt\n";
+        MPI_Finalize();
+        return 2;
+    }
+
+    selectAlphabet(ALPHABET_PRINTABLE);
+    int Nd=currentAlphabet().symbols;
+
+    Matrix<uint32_t> R(Nd, Nd);
+    buildTransitionMat(R, Nd, std::vector<std::string>(1, argv[1]));
+    SparseBigram<uint32_t> C;
+    buildSparseTransitionMat(C, Nd, argv[2]);
+    SparseBigram<uint32_t> Cq;
+    buildSparseTransitionMat(Cq, Nd, argv[2]);
+    quantizeScorer(Cq, R, Nd);
+
+    int failures=0;
+    double temps[3]={1, 10, 100};
+    for (int k=0; k<3; ++k)
+    {
+        failures+=compareBackends<95>(R, C, Cq, Nd, temps[k], 2020+k);
+        failures+=compareBackends<0>(R, C, Cq, Nd, temps[k], 2030+k);
+    }
+
+    MPI_Finalize();
+    return (failures==0) ? 0 : 1;
+}